@@ -0,0 +1,364 @@
+// ============================================================================
+// Jonathan Park (jjp1)
+// Ben Parr (bparr)
+//
+// File: batch.c
+// Description: Batch implementation of a KenKen puzzle solver, which solves a
+//              stream of puzzles with one puzzle per processor at a time.
+//
+// CS418 Project
+// ============================================================================
+
+#include "kenken.h"
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <omp.h>
+
+// Initial number of results that can be held until they are printed
+#define INITIAL_RESULTS_CAPACITY 1024
+
+// Calculate number of milliseconds between two timevals
+#define TIME_DIFF(b, a) (((b).tv_sec - (a).tv_sec) * 1000.0 + \
+                         ((b).tv_usec - (a).tv_usec) / 1000.0)
+
+// Puzzles read from a list of input files, in order. Each file can hold any
+// number of puzzles.
+typedef struct puzzle_stream {
+  char** files;
+  int numFiles;
+  // Index of the next file to open
+  int nextFileIndex;
+  // File being read, or NULL if none is open
+  FILE* in;
+  char* file;
+  // Number of puzzles read so far
+  long numPuzzles;
+} puzzle_stream_t;
+
+// Puzzle read from the stream. Puzzles are read from the stream one at a
+// time, but their text is parsed by the processor solving them.
+typedef struct puzzle {
+  // Position of the puzzle in the stream
+  long index;
+  // File the puzzle was read from
+  char* file;
+  puzzletext_t* text;
+} puzzle_t;
+
+// Algorithm functions
+void runBatch(unsigned P);
+void openStream(char* path);
+int openNextFile();
+int readPuzzle(puzzle_t* puzzle);
+char* solvePuzzle(puzzle_t* puzzle, long long* myNodeCount,
+                  long long* myCacheHits, long long* myCacheMisses,
+                  long* myNumUnsolved);
+void printResult(long index, char* output);
+void usage(char* program);
+
+
+// Number of processors
+unsigned P;
+// Which solutions to search for
+solvemode_t mode;
+// Search options for the solver
+searchoptions_t options;
+// Stream of puzzles to solve
+puzzle_stream_t stream;
+// Output of solved puzzles, indexed by position in the stream, that can not
+// be printed until the puzzles before them are
+char** results;
+long resultsCapacity;
+// Number of puzzles whose output has been printed
+long numPrinted;
+// Number of puzzles without a solution, when searching for the first
+long numUnsolved;
+// Number of nodes visited
+long long nodeCount;
+// Number of failed-state cache hits and misses
+long long cacheHits, cacheMisses;
+// Program execution timinges (in milliseconds)
+double totalTime, compTime;
+
+int main(int argc, char **argv) {
+  struct timeval startTime, endTime;
+
+  if (!getSearchOptions(&argc, argv, &options) ||
+      (int)(mode = getSolveMode(&argc, argv)) < 0 || argc != 3)
+    usage(argv[0]);
+
+  // Record start of total time
+  gettimeofday(&startTime, NULL);
+
+  // Initialize global variables and data-structures.
+  P = atoi(argv[1]);
+  openStream(argv[2]);
+  numPrinted = 0;
+  numUnsolved = 0;
+  nodeCount = 0;
+  cacheHits = 0;
+  cacheMisses = 0;
+
+  resultsCapacity = INITIAL_RESULTS_CAPACITY;
+  results = (char**)calloc(sizeof(char*), resultsCapacity);
+  if (!results)
+    unixError("Failed to allocate memory for the results");
+
+  runBatch(P);
+
+  // Use final time to calculate total time
+  gettimeofday(&endTime, NULL);
+  totalTime = TIME_DIFF(endTime, startTime);
+
+  // Print out number of puzzles and nodes visited, and calculated times
+  printf("Puzzles: %ld\n", stream.numPuzzles);
+  if (mode == FIRST_SOLUTION)
+    printf("Puzzles Without Solution: %ld\n", numUnsolved);
+  printf("Nodes Visited: %lld\n", nodeCount);
+  printCacheCounts(stdout, &options, cacheHits, cacheMisses);
+  printf("Computation Time = %.3f millisecs\n", compTime);
+  printf("      Total Time = %.3f millisecs\n", totalTime);
+  printf("      Throughput = %.1f puzzles/sec\n",
+         (compTime > 0) ? stream.numPuzzles * 1000.0 / compTime : 0.0);
+
+  free(results);
+  return (numUnsolved > 0);
+}
+
+// Sets up and runs the batch kenken solver
+void runBatch(unsigned P) {
+  int hasPuzzle;
+  long long myNodeCount;
+  long long myCacheHits, myCacheMisses;
+  long myNumUnsolved;
+  char* output;
+  puzzle_t myPuzzle;
+  struct timeval startCompTime, endCompTime;
+
+  // Begin parallel
+  omp_set_num_threads(P);
+
+  // Record start of computation time
+  gettimeofday(&startCompTime, NULL);
+
+  // Run algorithm
+#pragma omp parallel default(shared) private(hasPuzzle, myNodeCount, \
+                                             myCacheHits, myCacheMisses, \
+                                             myNumUnsolved, output, myPuzzle)
+{
+  // Initialize local variables and data-structures
+  myNodeCount = 0;
+  myCacheHits = 0;
+  myCacheMisses = 0;
+  myNumUnsolved = 0;
+
+  myPuzzle.text = allocatePuzzleText();
+
+  // Solve the next puzzle in the stream until none are left, so processors
+  // that get easy puzzles solve more of them
+  while (1) {
+    #pragma omp critical(stream)
+      hasPuzzle = readPuzzle(&myPuzzle);
+
+    if (!hasPuzzle)
+      break;
+
+    output = solvePuzzle(&myPuzzle, &myNodeCount, &myCacheHits,
+                         &myCacheMisses, &myNumUnsolved);
+    printResult(myPuzzle.index, output);
+  }
+
+  freePuzzleText(myPuzzle.text);
+
+  #pragma omp critical
+  {
+    nodeCount += myNodeCount;
+    cacheHits += myCacheHits;
+    cacheMisses += myCacheMisses;
+    numUnsolved += myNumUnsolved;
+  }
+}
+
+  // Calculate computation time
+  gettimeofday(&endCompTime, NULL);
+  compTime = TIME_DIFF(endCompTime, startCompTime);
+}
+
+// Set up the stream to read puzzles from path. A directory's files are read
+// in order of their names, and "-" reads from stdin.
+void openStream(char* path) {
+  int i, numEntries;
+  char* file;
+  struct stat pathStat;
+  struct dirent** entries;
+
+  stream.in = NULL;
+  stream.nextFileIndex = 0;
+  stream.numPuzzles = 0;
+
+  if (strcmp(path, "-") == 0 || stat(path, &pathStat) ||
+      !S_ISDIR(pathStat.st_mode)) {
+    stream.files = (char**)malloc(sizeof(char*));
+    if (!stream.files)
+      unixError("Failed to allocate memory for the input files");
+
+    stream.files[0] = path;
+    stream.numFiles = 1;
+    return;
+  }
+
+  if ((numEntries = scandir(path, &entries, NULL, alphasort)) < 0)
+    unixError("Failed to read input directory");
+
+  stream.files = (char**)malloc(sizeof(char*) * (numEntries + 1));
+  if (!stream.files)
+    unixError("Failed to allocate memory for the input files");
+
+  // Only read regular files, skipping hidden ones
+  stream.numFiles = 0;
+  for (i = 0; i < numEntries; i++) {
+    if (entries[i]->d_name[0] != '.') {
+      file = (char*)malloc(strlen(path) + strlen(entries[i]->d_name) + 2);
+      if (!file)
+        unixError("Failed to allocate memory for the input files");
+
+      sprintf(file, "%s/%s", path, entries[i]->d_name);
+      if (!stat(file, &pathStat) && S_ISREG(pathStat.st_mode))
+        stream.files[stream.numFiles++] = file;
+      else
+        free(file);
+    }
+
+    free(entries[i]);
+  }
+  free(entries);
+}
+
+// Close the current input file, and open the next one. Returns 0 if there are
+// no files left.
+int openNextFile() {
+  if (stream.in && stream.in != stdin)
+    fclose(stream.in);
+  stream.in = NULL;
+
+  if (stream.nextFileIndex >= stream.numFiles)
+    return 0;
+
+  stream.file = stream.files[stream.nextFileIndex++];
+  if (strcmp(stream.file, "-") == 0)
+    stream.in = stdin;
+  else if (!(stream.in = fopen(stream.file, "r")))
+    unixError("Failed to open input file");
+
+  return 1;
+}
+
+// Read the text of the next puzzle in the stream into puzzle. Returns 0 if
+// there are no puzzles left. Must only be called by one processor at a time.
+int readPuzzle(puzzle_t* puzzle) {
+  while (!stream.in || !readPuzzleText(stream.in, puzzle->text)) {
+    if (!openNextFile())
+      return 0;
+  }
+
+  puzzle->index = stream.numPuzzles++;
+  puzzle->file = stream.file;
+  return 1;
+}
+
+// Parse and solve a puzzle, and return its output, including the solutions,
+// number of nodes visited and computation time
+char* solvePuzzle(puzzle_t* puzzle, long long* myNodeCount,
+                  long long* myCacheHits, long long* myCacheMisses,
+                  long* myNumUnsolved) {
+  FILE* in, *out;
+  char* output;
+  size_t outputSize;
+  long long puzzleNodeCount = 0, numSolutions = 0;
+  long long puzzleCacheHits, puzzleCacheMisses;
+  kenken_solver_t* mySolver;
+  trail_t* myTrail;
+  writer_t* myWriter;
+  struct timeval startTime, endTime;
+  search_t search;
+  cellset_t conflict;
+
+  if (!(out = open_memstream(&output, &outputSize)))
+    unixError("Failed to open puzzle output");
+  fprintf(out, "Puzzle %ld (%s)\n", puzzle->index + 1, puzzle->file);
+
+  gettimeofday(&startTime, NULL);
+
+  if (!(in = fmemopen(puzzle->text->text, puzzle->text->size, "r")))
+    unixError("Failed to open puzzle text");
+  mySolver = readSolver(in);
+  fclose(in);
+  setSearchOptions(mySolver, &options);
+
+  myTrail = allocateTrail();
+  myWriter = allocateWriter(out);
+  initSearch(&search, mySolver, myTrail, mode, myWriter, &puzzleNodeCount,
+             &numSolutions);
+  searchNode(&search, 0, &conflict);
+
+  gettimeofday(&endTime, NULL);
+  puzzleCacheHits = mySolver->cacheHits;
+  puzzleCacheMisses = mySolver->cacheMisses;
+
+  freeWriter(myWriter);
+  freeTrail(myTrail);
+  freeSolver(mySolver);
+
+  if (mode == FIRST_SOLUTION && numSolutions == 0) {
+    fprintf(out, "No solution found\n");
+    (*myNumUnsolved)++;
+  }
+
+  printSolutionCount(out, mode, numSolutions);
+  fprintf(out, "Nodes Visited: %lld\n", puzzleNodeCount);
+  printCacheCounts(out, &options, puzzleCacheHits, puzzleCacheMisses);
+  fprintf(out, "Computation Time = %.3f millisecs\n\n",
+          TIME_DIFF(endTime, startTime));
+
+  if (fclose(out))
+    unixError("Failed to write puzzle output");
+
+  *myNodeCount += puzzleNodeCount;
+  *myCacheHits += puzzleCacheHits;
+  *myCacheMisses += puzzleCacheMisses;
+  return output;
+}
+
+// Hold the output of a solved puzzle until the puzzles before it are printed,
+// and print every puzzle's output that is no longer waiting on another
+void printResult(long index, char* output) {
+  #pragma omp critical(results)
+  {
+    while (index >= resultsCapacity) {
+      results = (char**)realloc(results, sizeof(char*) * 2 * resultsCapacity);
+      if (!results)
+        unixError("Failed to allocate memory for the results");
+
+      memset(&(results[resultsCapacity]), 0, sizeof(char*) * resultsCapacity);
+      resultsCapacity *= 2;
+    }
+
+    results[index] = output;
+    while (numPrinted < resultsCapacity && results[numPrinted]) {
+      fputs(results[numPrinted], stdout);
+      free(results[numPrinted]);
+      results[numPrinted++] = NULL;
+    }
+  }
+}
+
+// Print usage information and exit
+void usage(char* program) {
+  printf("Usage: %s [--count | --unique | --all] [search options] P input\n",
+         program);
+  printf(SEARCH_OPTIONS_USAGE);
+  printf("input is a file of puzzles, a directory of puzzle files, or - to "
+         "read from stdin\n");
+  exit(0);
+}
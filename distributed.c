@@ -0,0 +1,955 @@
+// ============================================================================
+// Jonathan Park (jjp1)
+// Ben Parr (bparr)
+//
+// File: distributed.c
+// Description: Distributed implementation of a KenKen puzzle solver, where a
+//              coordinator hands out jobs to worker processes over sockets.
+//
+// CS418 Project
+// ============================================================================
+
+#include "kenken.h"
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <errno.h>
+
+// Number of nodes a worker searches between checks for messages from the
+// coordinator. Must be a power of 2.
+#define POLL_NODES 1024
+// Number of bytes a connection buffers when receiving
+#define CONNECTION_BUFFER_SIZE 65536
+// Longest message line, which is a job with every cell assigned
+#define MAX_MESSAGE_LEN (16 + 8 * MAX_PROBLEM_SIZE * MAX_PROBLEM_SIZE)
+// Most jobs a worker can split the rest of its job into
+#define MAX_SPLIT_JOBS (MAX_PROBLEM_SIZE * MAX_PROBLEM_SIZE * MAX_PROBLEM_SIZE)
+// Most workers the coordinator can have connected at once
+#define MAX_WORKERS 1024
+// Number of connections the coordinator's socket queues before accepting them
+#define LISTEN_BACKLOG 64
+// Number of times a worker tries to connect to the coordinator, and the time
+// it waits between tries
+#define CONNECT_ATTEMPTS 50
+#define CONNECT_RETRY_USECS 100000
+// Initial number of jobs the coordinator's queue can hold
+#define INITIAL_QUEUE_CAPACITY 1024
+
+// Calculate number of milliseconds between two timevals
+#define TIME_DIFF(b, a) (((b).tv_sec - (a).tv_sec) * 1000.0 + \
+                         ((b).tv_usec - (a).tv_usec) / 1000.0)
+
+// Socket between the coordinator and a worker, with the bytes received but
+// not yet read
+typedef struct connection {
+  int fd;
+  int start;
+  int end;
+  char buffer[CONNECTION_BUFFER_SIZE];
+} connection_t;
+
+// Worker connected to the coordinator
+typedef struct worker {
+  connection_t connection;
+  // Whether the worker is searching a job, and the job
+  int busy;
+  job_t job;
+  // Whether the worker was asked to split its job, and has not answered
+  int splitRequested;
+} worker_t;
+
+// Jobs waiting for a worker, as a double-ended queue in a circular array. Jobs
+// are taken from the front in the serial search order, except by idle
+// workers, which take the jobs at the back, since those are the largest.
+typedef struct job_queue {
+  job_t* jobs;
+  long capacity;
+  long front;
+  long size;
+} job_queue_t;
+
+// Coordinator functions
+void runCoordinator(char* address, char* file, int numLocalWorkers);
+void readPuzzle(char* file);
+void acceptWorker(int listenFd);
+void removeWorker(int index);
+int handleMessage(worker_t* worker);
+void assignJobs();
+void requestSplits();
+void sendJob(worker_t* worker, job_t* job);
+void pushFront(job_queue_t* queue, job_t* job);
+void popFront(job_queue_t* queue, job_t* job);
+void popBack(job_queue_t* queue, job_t* job);
+
+// Worker functions
+void runWorker(char* address);
+void searchJob();
+int pollCoordinator(search_t* search, int step);
+int checkMessages(int step);
+int hasUntriedValues(int step);
+void sendResult(char* output, size_t outputSize);
+
+// Connection functions
+int openSocket(char* address, int listening);
+int receiveBytes(connection_t* connection);
+int readMessageLine(connection_t* connection, char* line);
+int readBytes(connection_t* connection, char* data, size_t size);
+int hasMessage(connection_t* connection);
+int sendBytes(int fd, char* data, size_t size);
+int formatJob(char* line, assignment_t* assignments, int length);
+int parseJob(char* line, job_t* job);
+void usage(char* program);
+
+
+// Which solutions to search for, which workers are sent by the coordinator
+solvemode_t mode;
+// Search options for the solver
+searchoptions_t options;
+
+// Text of the puzzle, sent to each worker
+char* puzzleText;
+size_t puzzleSize;
+// Workers connected to the coordinator
+worker_t* workers[MAX_WORKERS];
+int numWorkers;
+// Jobs waiting for a worker
+job_queue_t queue;
+// Whether enough solutions were found to stop the search
+int stopped;
+// Number of solutions found
+long long numSolutions;
+// Number of nodes visited
+long long nodeCount;
+// Program execution timinges (in milliseconds)
+double totalTime, compTime;
+
+// Worker's connection to the coordinator
+connection_t* coordinator;
+// Solver state at the root, which each job starts from
+kenken_solver_t* solver;
+// Solver state of the job being searched, and the trail of its deductions
+kenken_solver_t* mySolver;
+trail_t* myTrail;
+// Assignments of the nodes on the search's current path, starting with the
+// job's, and the possibles of each node's cell before its values were tried
+job_t path;
+domain_t pathPossibles[MAX_PROBLEM_SIZE * MAX_PROBLEM_SIZE];
+// Number of assignments in the job being searched
+int jobLength;
+// Number of nodes visited and solutions found searching the job
+long long jobNodeCount, jobSolutionCount;
+// Whether the coordinator asked to split the job, and whether the search
+// stopped to split it, at the node of splitStep
+int splitPending, splitting, splitStep;
+// Whether the coordinator stopped the search
+int cancelled;
+
+int main(int argc, char **argv) {
+  char* local = removeOptionValue(&argc, argv, "--local");
+
+  if (!getSearchOptions(&argc, argv, &options) ||
+      (int)(mode = getSolveMode(&argc, argv)) < 0 ||
+      (argc != 2 && argc != 3) || (local && argc != 3) ||
+      (local && atoi(local) < 0))
+    usage(argv[0]);
+
+  if (argc == 2)
+    runWorker(argv[1]);
+  else
+    runCoordinator(argv[1], argv[2], local ? atoi(local) : 0);
+
+  return 0;
+}
+
+// Listen for workers, and hand out jobs to them until the search is over.
+// Local workers are started as child processes connecting to the address.
+void runCoordinator(char* address, char* file, int numLocalWorkers) {
+  int i, listenFd, numPolled, timeout;
+  job_t rootJob;
+  struct pollfd fds[MAX_WORKERS + 1];
+  struct timeval startTime, startCompTime, endTime;
+
+  // Record start of total time
+  gettimeofday(&startTime, NULL);
+
+  readPuzzle(file);
+  listenFd = openSocket(address, 1);
+
+  for (i = 0; i < numLocalWorkers; i++) {
+    switch (fork()) {
+      case -1:
+        unixError("Failed to start a local worker");
+      case 0:
+        close(listenFd);
+        runWorker(address);
+        exit(0);
+    }
+  }
+
+  // Initialize global variables and data-structures
+  queue.capacity = INITIAL_QUEUE_CAPACITY;
+  queue.jobs = (job_t*)malloc(sizeof(job_t) * queue.capacity);
+  if (!queue.jobs)
+    unixError("Failed to allocate memory for the job queue");
+  queue.front = 0;
+  queue.size = 0;
+  numWorkers = 0;
+  stopped = 0;
+  numSolutions = 0;
+  nodeCount = 0;
+
+  // Add initial job (nothing assigned)
+  rootJob.length = 0;
+  pushFront(&queue, &rootJob);
+
+  gettimeofday(&startCompTime, NULL);
+
+  // Hand out jobs until enough solutions are found, or every job is searched
+  while (!stopped) {
+    assignJobs();
+    requestSplits();
+
+    timeout = -1;
+    for (i = 0; i < numWorkers; i++) {
+      if (workers[i]->busy)
+        break;
+    }
+    if (i == numWorkers && queue.size == 0)
+      break;
+
+    fds[0].fd = listenFd;
+    fds[0].events = POLLIN;
+    for (i = 0; i < numWorkers; i++) {
+      fds[i + 1].fd = workers[i]->connection.fd;
+      fds[i + 1].events = POLLIN;
+
+      // Messages already received are handled without waiting
+      if (workers[i]->connection.start < workers[i]->connection.end)
+        timeout = 0;
+    }
+
+    numPolled = numWorkers;
+    if (poll(fds, numPolled + 1, timeout) < 0) {
+      if (errno == EINTR)
+        continue;
+      unixError("Failed to wait for workers");
+    }
+
+    if (fds[0].revents & POLLIN)
+      acceptWorker(listenFd);
+
+    // Workers are removed by moving the last worker into their place, which
+    // was either handled already or is newly accepted
+    for (i = numPolled - 1; i >= 0; i--) {
+      if ((fds[i + 1].revents ||
+           workers[i]->connection.start < workers[i]->connection.end) &&
+          !handleMessage(workers[i]))
+        removeWorker(i);
+    }
+  }
+
+  gettimeofday(&endTime, NULL);
+  compTime = TIME_DIFF(endTime, startCompTime);
+
+  // Stop the workers, which cancels any job still being searched
+  for (i = 0; i < numWorkers; i++) {
+    sendBytes(workers[i]->connection.fd, "STOP\n", 5);
+    close(workers[i]->connection.fd);
+    free(workers[i]);
+  }
+  close(listenFd);
+  if (!strchr(address, ':') || strchr(address, '/'))
+    unlink(address);
+  while (wait(NULL) > 0);
+
+  free(queue.jobs);
+  free(puzzleText);
+
+  // Use final time to calculate total time
+  gettimeofday(&endTime, NULL);
+  totalTime = TIME_DIFF(endTime, startTime);
+
+  // Print out number of solutions and nodes visited, and calculated times
+  printSolutionCount(stdout, mode, numSolutions);
+  printf("Nodes Visited: %lld\n", nodeCount);
+  printf("Computation Time = %.3f millisecs\n", compTime);
+  printf("      Total Time = %.3f millisecs\n", totalTime);
+
+  // Fail after the nodes visited are printed, so they can still be merged
+  if (mode == FIRST_SOLUTION && numSolutions == 0)
+    appError("No solution found");
+}
+
+// Read the text of the puzzle to send to workers, and check it can be parsed
+void readPuzzle(char* file) {
+  char buffer[MAX_LINE_LEN];
+  size_t size;
+  FILE* in, *out;
+
+  if (!(in = fopen(file, "r")))
+    unixError("Failed to open input file");
+  if (!(out = open_memstream(&puzzleText, &puzzleSize)))
+    unixError("Failed to open puzzle text");
+
+  while ((size = fread(buffer, 1, MAX_LINE_LEN, in)) > 0)
+    fwrite(buffer, 1, size, out);
+
+  if (ferror(in) || fclose(out))
+    unixError("Failed to read input file");
+  fclose(in);
+
+  if (!(in = fmemopen(puzzleText, puzzleSize, "r")))
+    unixError("Failed to open puzzle text");
+  freeSolver(readSolver(in));
+  fclose(in);
+}
+
+// Accept a worker's connection, and send it the puzzle
+void acceptWorker(int listenFd) {
+  int fd, noDelay = 1;
+  char header[MAX_MESSAGE_LEN];
+  worker_t* worker;
+
+  // The worker may have given up before being accepted
+  if ((fd = accept(listenFd, NULL, NULL)) < 0)
+    return;
+
+  if (numWorkers == MAX_WORKERS) {
+    close(fd);
+    return;
+  }
+
+  // Fails for Unix sockets, which never delay messages anyway
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+  worker = (worker_t*)malloc(sizeof(worker_t));
+  if (!worker)
+    unixError("Failed to allocate memory for a worker");
+  worker->connection.fd = fd;
+  worker->connection.start = 0;
+  worker->connection.end = 0;
+  worker->busy = 0;
+  worker->splitRequested = 0;
+
+  sprintf(header, "PUZZLE %d %zu\n", (int)mode, puzzleSize);
+  if (!sendBytes(fd, header, strlen(header)) ||
+      !sendBytes(fd, puzzleText, puzzleSize)) {
+    close(fd);
+    free(worker);
+    return;
+  }
+
+  workers[numWorkers++] = worker;
+}
+
+// Disconnect a worker that failed, putting its job back in the queue to be
+// searched again from the start
+void removeWorker(int index) {
+  worker_t* worker = workers[index];
+
+  if (worker->busy) {
+    fprintf(stderr, "Lost a worker, reassigning its job\n");
+    pushFront(&queue, &(worker->job));
+  }
+
+  close(worker->connection.fd);
+  free(worker);
+  workers[index] = workers[--numWorkers];
+}
+
+// Read a worker's result for its job: the nodes it visited, the solutions it
+// found and their output, then the jobs left if it split its job. Nothing is
+// counted until the whole message is read, so a worker failing in the middle
+// of it has its whole job searched again. Returns 0 if the worker failed.
+int handleMessage(worker_t* worker) {
+  char line[MAX_MESSAGE_LEN];
+  char* output;
+  int i, numJobs;
+  size_t outputSize;
+  long long workerNodeCount, workerSolutionCount;
+  job_t* jobs;
+  job_t nextJob;
+
+  if (!readMessageLine(&(worker->connection), line) ||
+      sscanf(line, "DONE %lld %lld %zu %d", &workerNodeCount,
+             &workerSolutionCount, &outputSize, &numJobs) != 4 ||
+      !worker->busy || numJobs < 0 || numJobs > MAX_SPLIT_JOBS)
+    return 0;
+
+  output = (char*)malloc(outputSize + 1);
+  jobs = (job_t*)malloc(sizeof(job_t) * (numJobs + 1));
+  if (!output || !jobs)
+    unixError("Failed to allocate memory for a worker's result");
+
+  if (!readBytes(&(worker->connection), output, outputSize)) {
+    free(output);
+    free(jobs);
+    return 0;
+  }
+  output[outputSize] = '\0';
+
+  for (i = 0; i < numJobs; i++) {
+    if (!readMessageLine(&(worker->connection), line) ||
+        !parseJob(line, &(jobs[i]))) {
+      free(output);
+      free(jobs);
+      return 0;
+    }
+  }
+
+  worker->busy = 0;
+  worker->splitRequested = 0;
+
+  if (!stopped) {
+    // Only the first solution is written unless writing all of them
+    if (mode == ALL_SOLUTIONS || numSolutions == 0)
+      fputs(output, stdout);
+
+    nodeCount += workerNodeCount;
+    numSolutions += workerSolutionCount;
+    stopped = STOP_SEARCH(mode, numSolutions);
+
+    // The jobs left are in the serial search order, so the worker continues
+    // with the rest of its job, or otherwise the next job in the order
+    for (i = numJobs - 1; i >= 0; i--)
+      pushFront(&queue, &(jobs[i]));
+    if (!stopped && queue.size > 0) {
+      popFront(&queue, &nextJob);
+      sendJob(worker, &nextJob);
+    }
+  }
+
+  free(output);
+  free(jobs);
+  return 1;
+}
+
+// Hand out the largest jobs waiting to the idle workers
+void assignJobs() {
+  int i;
+  job_t job;
+
+  for (i = 0; i < numWorkers && queue.size > 0; i++) {
+    if (!workers[i]->busy) {
+      popBack(&queue, &job);
+      sendJob(workers[i], &job);
+    }
+  }
+}
+
+// Ask busy workers to split their jobs until there is a split coming for
+// every idle worker, starting with the shortest jobs, which are the largest
+void requestSplits() {
+  int i, numIdle = 0, numRequested = 0;
+  worker_t* worker;
+
+  for (i = 0; i < numWorkers; i++) {
+    if (!workers[i]->busy)
+      numIdle++;
+    else if (workers[i]->splitRequested)
+      numRequested++;
+  }
+
+  while (numRequested < numIdle) {
+    worker = NULL;
+    for (i = 0; i < numWorkers; i++) {
+      if (workers[i]->busy && !workers[i]->splitRequested &&
+          (!worker || workers[i]->job.length < worker->job.length))
+        worker = workers[i];
+    }
+
+    if (!worker)
+      break;
+
+    // A worker failing to receive this is found when reading from it
+    sendBytes(worker->connection.fd, "SPLIT\n", 6);
+    worker->splitRequested = 1;
+    numRequested++;
+  }
+}
+
+// Send a job to a worker. A worker failing to receive it is found when
+// reading from it, and the job is then put back in the queue.
+void sendJob(worker_t* worker, job_t* job) {
+  char line[MAX_MESSAGE_LEN];
+  int length = formatJob(line, job->assignments, job->length);
+
+  copyJob(&(worker->job), job);
+  worker->busy = 1;
+  worker->splitRequested = 0;
+  sendBytes(worker->connection.fd, line, length);
+}
+
+// Push a job onto the front of a job queue, growing the queue if full
+void pushFront(job_queue_t* queue, job_t* job) {
+  long i;
+  job_t* jobs;
+
+  if (queue->size == queue->capacity) {
+    jobs = (job_t*)malloc(sizeof(job_t) * queue->capacity * 2);
+    if (!jobs)
+      unixError("Failed to grow the job queue");
+
+    for (i = 0; i < queue->size; i++)
+      copyJob(&(jobs[i]),
+              &(queue->jobs[(queue->front + i) % queue->capacity]));
+
+    free(queue->jobs);
+    queue->jobs = jobs;
+    queue->capacity *= 2;
+    queue->front = 0;
+  }
+
+  queue->front = (queue->front + queue->capacity - 1) % queue->capacity;
+  copyJob(&(queue->jobs[queue->front]), job);
+  queue->size++;
+}
+
+// Pop the job at the front of a non-empty job queue into job
+void popFront(job_queue_t* queue, job_t* job) {
+  copyJob(job, &(queue->jobs[queue->front]));
+  queue->front = (queue->front + 1) % queue->capacity;
+  queue->size--;
+}
+
+// Pop the job at the back of a non-empty job queue into job
+void popBack(job_queue_t* queue, job_t* job) {
+  queue->size--;
+  copyJob(job,
+          &(queue->jobs[(queue->front + queue->size) % queue->capacity]));
+}
+
+// Connect to the coordinator, then search the jobs it sends until it stops
+// the search or disconnects
+void runWorker(char* address) {
+  int i, fd = -1, sentMode;
+  char line[MAX_MESSAGE_LEN];
+  char* text;
+  size_t size;
+  FILE* in;
+
+  // The coordinator may not be listening yet
+  for (i = 0; i < CONNECT_ATTEMPTS && fd < 0; i++) {
+    if ((fd = openSocket(address, 0)) < 0)
+      usleep(CONNECT_RETRY_USECS);
+  }
+  if (fd < 0)
+    unixError("Failed to connect to the coordinator");
+
+  coordinator = (connection_t*)malloc(sizeof(connection_t));
+  if (!coordinator)
+    unixError("Failed to allocate memory for the connection");
+  coordinator->fd = fd;
+  coordinator->start = 0;
+  coordinator->end = 0;
+
+  // Read the puzzle, and which solutions to search for
+  if (!readMessageLine(coordinator, line) ||
+      sscanf(line, "PUZZLE %d %zu", &sentMode, &size) != 2)
+    appError("Failed to receive the puzzle");
+
+  text = (char*)malloc(size);
+  if (!text)
+    unixError("Failed to allocate memory for the puzzle text");
+  if (!readBytes(coordinator, text, size))
+    appError("Failed to receive the puzzle");
+
+  if (!(in = fmemopen(text, size, "r")))
+    unixError("Failed to open puzzle text");
+  solver = readSolver(in);
+  fclose(in);
+  free(text);
+
+  mode = (solvemode_t)sentMode;
+  setSearchOptions(solver, &options);
+  mySolver = cloneSolver(solver);
+  myTrail = allocateTrail();
+  cancelled = 0;
+
+  // Requests to split a job that already finished are ignored
+  while (!cancelled && readMessageLine(coordinator, line) &&
+         strcmp(line, "STOP") != 0) {
+    if (strncmp(line, "JOB ", 4) == 0) {
+      if (!parseJob(line, &path))
+        appError("Received an invalid job");
+      searchJob();
+    }
+  }
+
+  close(coordinator->fd);
+  free(coordinator);
+  freeTrail(myTrail);
+  freeSolver(mySolver);
+  freeSolver(solver);
+}
+
+// Search the job in path from the root state, then send the coordinator its
+// result, unless the coordinator cancelled it
+void searchJob() {
+  char* output;
+  size_t outputSize;
+  FILE* out;
+  writer_t* myWriter;
+  search_t search;
+  cellset_t conflict;
+
+  loadJob(mySolver, solver, myTrail, &path);
+
+  jobLength = path.length;
+  jobNodeCount = 0;
+  jobSolutionCount = 0;
+  splitPending = 0;
+  splitting = 0;
+
+  if (!(out = open_memstream(&output, &outputSize)))
+    unixError("Failed to open job output");
+  myWriter = allocateWriter(out);
+
+  // The search records its path, so the rest of the job can be split off
+  initSearch(&search, mySolver, myTrail, mode, myWriter, &jobNodeCount,
+             &jobSolutionCount);
+  search.stopNode = pollCoordinator;
+  search.path = path.assignments;
+  search.pathPossibles = pathPossibles;
+  searchNode(&search, jobLength, &conflict);
+
+  freeWriter(myWriter);
+  if (fclose(out))
+    unixError("Failed to write job output");
+
+  if (!cancelled)
+    sendResult(output, outputSize);
+  free(output);
+}
+
+// Check for messages from the coordinator now and then, before a node is
+// counted, so the node is left for the rest of the job if the job is split
+// there. Solutions are never split at. Returns whether the search should stop.
+int pollCoordinator(search_t* search, int step) {
+  return step < mySolver->totalNumCells &&
+         (jobNodeCount & (POLL_NODES - 1)) == 0 && checkMessages(step);
+}
+
+// Handle the messages the coordinator sent while searching. Returns whether
+// the search should stop, because the coordinator cancelled it, or because
+// the job is split at the current node.
+int checkMessages(int step) {
+  char line[MAX_MESSAGE_LEN];
+
+  while (hasMessage(coordinator)) {
+    if (!readMessageLine(coordinator, line) || strcmp(line, "STOP") == 0) {
+      cancelled = 1;
+      return 1;
+    }
+
+    if (strcmp(line, "SPLIT") == 0)
+      splitPending = 1;
+  }
+
+  // Only split once a node above has values left to try, so the rest of the
+  // job is split into more than one job
+  if (splitPending && hasUntriedValues(step)) {
+    splitting = 1;
+    splitStep = step;
+    return 1;
+  }
+
+  return 0;
+}
+
+// Whether any node of the job above the given step has values left to try
+int hasUntriedValues(int step) {
+  int values[MAX_PROBLEM_SIZE];
+
+  for (step--; step >= jobLength; step--) {
+    if (getUntriedValues(mySolver, path.assignments[step].cellIndex,
+                         pathPossibles[step], path.assignments[step].value,
+                         values) > 0)
+      return 1;
+  }
+
+  return 0;
+}
+
+// Send the coordinator the job's result: the nodes visited, the solutions
+// found and their output, then the jobs left if the job was split. The jobs
+// left are the node the search stopped at, followed by the values left to try
+// at each node above it from the deepest up, which is the serial search order.
+void sendResult(char* output, size_t outputSize) {
+  char line[MAX_MESSAGE_LEN];
+  char* jobsText;
+  int i, step, numValues, value, numJobs = 0;
+  int values[MAX_PROBLEM_SIZE];
+  size_t jobsSize;
+  FILE* out;
+
+  if (!(out = open_memstream(&jobsText, &jobsSize)))
+    unixError("Failed to open job output");
+
+  if (splitting) {
+    fwrite(line, 1, formatJob(line, path.assignments, splitStep), out);
+    numJobs++;
+
+    for (step = splitStep - 1; step >= jobLength; step--) {
+      value = path.assignments[step].value;
+      numValues = getUntriedValues(mySolver, path.assignments[step].cellIndex,
+                                   pathPossibles[step], value, values);
+
+      for (i = 0; i < numValues; i++) {
+        path.assignments[step].value = values[i];
+        fwrite(line, 1, formatJob(line, path.assignments, step + 1), out);
+        numJobs++;
+      }
+
+      path.assignments[step].value = value;
+    }
+  }
+
+  if (fclose(out))
+    unixError("Failed to write job output");
+
+  // A coordinator failing to receive this has stopped, which is found when
+  // reading its next message
+  sprintf(line, "DONE %lld %lld %zu %d\n", jobNodeCount, jobSolutionCount,
+          outputSize, numJobs);
+  if (sendBytes(coordinator->fd, line, strlen(line)) &&
+      sendBytes(coordinator->fd, output, outputSize))
+    sendBytes(coordinator->fd, jobsText, jobsSize);
+
+  free(jobsText);
+}
+
+// Open a socket on an address, which is host:port for TCP, or otherwise the
+// path of a Unix socket. The coordinator listens on the address, and workers
+// connect to it. Returns the socket, or -1 if a worker failed to connect.
+int openSocket(char* address, int listening) {
+  int fd = -1, on = 1;
+  char host[MAX_LINE_LEN];
+  char* port = strrchr(address, ':');
+  struct sockaddr_un unixAddress;
+  struct addrinfo hints;
+  struct addrinfo* addresses, *ai;
+
+  if (!port || strchr(address, '/')) {
+    if (strlen(address) >= sizeof(unixAddress.sun_path))
+      appError("Socket path too long");
+
+    memset(&unixAddress, 0, sizeof(unixAddress));
+    unixAddress.sun_family = AF_UNIX;
+    strcpy(unixAddress.sun_path, address);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+      unixError("Failed to open socket");
+
+    if (listening) {
+      unlink(address);
+      if (bind(fd, (struct sockaddr*)&unixAddress, sizeof(unixAddress)) < 0 ||
+          listen(fd, LISTEN_BACKLOG) < 0)
+        unixError("Failed to listen on socket");
+    }
+    else if (connect(fd, (struct sockaddr*)&unixAddress,
+                     sizeof(unixAddress)) < 0) {
+      close(fd);
+      return -1;
+    }
+
+    return fd;
+  }
+
+  if (port - address >= MAX_LINE_LEN)
+    appError("Host name too long");
+  memcpy(host, address, port - address);
+  host[port - address] = '\0';
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = listening ? AI_PASSIVE : 0;
+  if (getaddrinfo(host[0] ? host : NULL, port + 1, &hints, &addresses) != 0)
+    appError("Failed to resolve socket address");
+
+  for (ai = addresses; ai; ai = ai->ai_next) {
+    if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+      continue;
+
+    // Messages are small, and waited on, so are sent without delay
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    if (listening) {
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+      if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+          listen(fd, LISTEN_BACKLOG) == 0)
+        break;
+    }
+    else if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+      break;
+
+    close(fd);
+    fd = -1;
+  }
+
+  freeaddrinfo(addresses);
+  if (listening && fd < 0)
+    unixError("Failed to listen on socket");
+  return fd;
+}
+
+// Receive more bytes into a connection's buffer, after moving the bytes not
+// yet read to its start. Returns 0 if the connection closed or failed.
+int receiveBytes(connection_t* connection) {
+  ssize_t size;
+
+  if (connection->start > 0) {
+    memmove(connection->buffer, &(connection->buffer[connection->start]),
+            connection->end - connection->start);
+    connection->end -= connection->start;
+    connection->start = 0;
+  }
+
+  do {
+    size = read(connection->fd, &(connection->buffer[connection->end]),
+                CONNECTION_BUFFER_SIZE - connection->end);
+  } while (size < 0 && errno == EINTR);
+
+  if (size <= 0)
+    return 0;
+
+  connection->end += size;
+  return 1;
+}
+
+// Read a line of a message from a connection into line, without its newline,
+// waiting until it is received. Returns 0 if the connection closed or failed,
+// or the line is too long.
+int readMessageLine(connection_t* connection, char* line) {
+  char* start, *newline;
+  int length;
+
+  while (1) {
+    start = &(connection->buffer[connection->start]);
+    length = connection->end - connection->start;
+    if ((newline = (char*)memchr(start, '\n', length)))
+      break;
+
+    if (length >= MAX_MESSAGE_LEN || !receiveBytes(connection))
+      return 0;
+  }
+
+  length = newline - start;
+  if (length >= MAX_MESSAGE_LEN)
+    return 0;
+
+  memcpy(line, start, length);
+  line[length] = '\0';
+  connection->start += length + 1;
+  return 1;
+}
+
+// Read the given number of bytes from a connection into data, waiting until
+// they are received. Returns 0 if the connection closed or failed.
+int readBytes(connection_t* connection, char* data, size_t size) {
+  size_t length;
+
+  while (size > 0) {
+    if (connection->start == connection->end && !receiveBytes(connection))
+      return 0;
+
+    length = connection->end - connection->start;
+    if (length > size)
+      length = size;
+
+    memcpy(data, &(connection->buffer[connection->start]), length);
+    connection->start += length;
+    data += length;
+    size -= length;
+  }
+
+  return 1;
+}
+
+// Whether a message can be read from a connection without waiting. A closed
+// or failed connection can be read without waiting, and the read fails.
+int hasMessage(connection_t* connection) {
+  struct pollfd fd;
+
+  if (connection->start < connection->end)
+    return 1;
+
+  fd.fd = connection->fd;
+  fd.events = POLLIN;
+  return poll(&fd, 1, 0) > 0;
+}
+
+// Send bytes on a socket. Returns 0 if the socket closed or failed, without
+// raising SIGPIPE.
+int sendBytes(int fd, char* data, size_t size) {
+  ssize_t sent;
+
+  while (size > 0) {
+    sent = send(fd, data, size, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR)
+      continue;
+    if (sent <= 0)
+      return 0;
+
+    data += sent;
+    size -= sent;
+  }
+
+  return 1;
+}
+
+// Format a job's message line into line. Returns the line's length.
+int formatJob(char* line, assignment_t* assignments, int length) {
+  int i, size;
+
+  size = sprintf(line, "JOB %d", length);
+  for (i = 0; i < length; i++)
+    size += sprintf(&(line[size]), " %d %d", assignments[i].cellIndex,
+                    assignments[i].value);
+
+  line[size++] = '\n';
+  line[size] = '\0';
+  return size;
+}
+
+// Parse a job's message line into job. Returns 0 if the line is not a valid
+// job.
+int parseJob(char* line, job_t* job) {
+  int i, offset;
+  assignment_t* assignment;
+
+  if (sscanf(line, "JOB %d%n", &(job->length), &offset) != 1 ||
+      job->length < 0 || job->length > MAX_PROBLEM_SIZE * MAX_PROBLEM_SIZE)
+    return 0;
+
+  for (i = 0; i < job->length; i++) {
+    line += offset;
+    assignment = &(job->assignments[i]);
+    if (sscanf(line, "%d %d%n", &(assignment->cellIndex), &(assignment->value),
+               &offset) != 2 ||
+        assignment->cellIndex < 0 ||
+        assignment->cellIndex >= MAX_PROBLEM_SIZE * MAX_PROBLEM_SIZE ||
+        assignment->value < 1 || assignment->value > MAX_PROBLEM_SIZE)
+      return 0;
+  }
+
+  return 1;
+}
+
+// Print usage information and exit
+void usage(char* program) {
+  printf("Usage: %s [--count | --unique | --all] [search options] "
+         "[--local N] address filename\n", program);
+  printf("       %s [search options] address\n", program);
+  printf(SEARCH_OPTIONS_USAGE);
+  printf("address is host:port for TCP, or the path of a Unix socket. With a "
+         "filename,\nthe coordinator hands out jobs to workers, starting N "
+         "local workers itself.\n");
+  exit(0);
+}
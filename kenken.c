@@ -8,318 +8,1987 @@
 // CS418 Project
 // ============================================================================
 
-#include "kenken.h"
-
-// Maximum line length of input file
-#define MAX_LINE_LEN 2048
+#include <sys/mman.h>
+#include "kenken_internal.h"
+
+#ifdef AVX2_KERNELS
+#include <immintrin.h>
+#endif
+
+// Performance counters are read through perf_event_open, which is only on
+// Linux
+#ifdef __linux__
+#define PERF_COUNTERS
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
 
 // Get cell at (x, y)
 #define GET_CELL(x, y) (N * (x) + (y))
-// Value of node at start and end of cell list
-#define END_NODE -1
-
-// Indexes of different types of constraints in cell_t constraint array
+// Byte alignment of each array in the cells
+#define CELLS_ALIGNMENT 32
+// Round a number of bytes up to the cells alignment
+#define ALIGN_UP(n) (((n) + CELLS_ALIGNMENT - 1) & ~(CELLS_ALIGNMENT - 1))
+// Number of values in each cell's value order, including the end marker
+#define VALUE_ORDER_SIZE (MAX_PROBLEM_SIZE + 1)
+// Number of 64-bit words in each bucket's bitset of cells
+#define BUCKET_WORDS ((MAX_PROBLEM_SIZE * MAX_PROBLEM_SIZE + 63) / 64)
+// Smallest problem size where keeping cells in buckets is faster than scanning
+// all cells for the next cell to fill in
+#define MIN_BUCKETS_PROBLEM_SIZE 13
+// Smallest problem size where propagating line constraints saves more search
+// than it costs
+#define MIN_PROPAGATION_PROBLEM_SIZE 6
+// Initial number of entries in a trail
+#define INITIAL_TRAIL_CAPACITY 1024
+// Initial number of bytes in a puzzle's text
+#define INITIAL_TEXT_CAPACITY 4096
+// Initial number of tuples a cage table has room for
+#define INITIAL_TABLE_CAPACITY 64
+// Bitset of a cage table's tuples with value at position
+#define TUPLE_SET(table, position, value) (&((table)->tupleSets[ \
+  ((position) * (MAX_PROBLEM_SIZE + 1) + (value)) * (table)->numWords]))
+// Masks of the values at each position of a cage table's tuples with value at
+// position
+#define SINGLE_MASKS(table, position, value) (&((table)->singleMasks[ \
+  ((position) * (MAX_PROBLEM_SIZE + 1) + (value)) * (table)->numCells]))
+
+// Indexes of different types of constraints in cells' constraint arrays
 #define ROW_CONSTRAINT_INDEX 0
 #define COLUMN_CONSTRAINT_INDEX 1
 #define BLOCK_CONSTRAINT_INDEX 2
+// Index of the mask of values ruled out by propagation in cells' mask arrays
+#define DEDUCTION_MASK_INDEX 3
+
+// Possible values of a cell, given the cells' masks
+#define POSSIBLES(masks, i) ((masks)[0][i] & (masks)[1][i] & (masks)[2][i] & \
+                             (masks)[3][i])
+// Bitset of the line constraints of a cell, given the cells' constraint indexes
+#define LINE_BITS(constraintIndexes, i) \
+  ((1ULL << (constraintIndexes)[ROW_CONSTRAINT_INDEX][i]) | \
+   (1ULL << (constraintIndexes)[COLUMN_CONSTRAINT_INDEX][i]))
+
+// Add a cell to a set of cells
+#define ADD_TO_CELL_SET(s, i) ((s)->words[(i) / 64] |= 1ULL << ((i) % 64))
+// Remove a cell from a set of cells
+#define REMOVE_FROM_CELL_SET(s, i) \
+  ((s)->words[(i) / 64] &= ~(1ULL << ((i) % 64)))
+// Index of the list of nogoods with a cell's value
+#define NOGOOD_LIST(cellIndex, value) \
+  ((cellIndex) * (MAX_PROBLEM_SIZE + 1) + (value))
+// Index of the list of nogoods watching a nogood's watched cell value
+#define WATCH_LIST(nogood) NOGOOD_LIST((nogood)->cellIndexes[(nogood)->watch], \
+                                       (nogood)->values[(nogood)->watch])
+
+// Random keys hashed into a solver's state: one for each cell being assigned,
+// one for each value of each line, and one for each value of each cell
+#define CELL_KEY(solver, cellIndex) ((solver)->stateKeys[cellIndex])
+#define LINE_KEY(solver, line, value) \
+  ((solver)->stateKeys[(solver)->totalNumCells + \
+                       (line) * ((solver)->N + 1) + (value)])
+#define VALUE_KEY(solver, cellIndex, value) \
+  ((solver)->stateKeys[(solver)->totalNumCells + \
+                       (NUM_CELL_LINES * (solver)->N + (cellIndex)) * \
+                       ((solver)->N + 1) + (value)])
+// Number of random keys hashed into a solver's state
+#define NUM_STATE_KEYS(solver) \
+  ((solver)->totalNumCells + \
+   (NUM_CELL_LINES * (solver)->N + (solver)->totalNumCells) * ((solver)->N + 1))
+// Bucket of the failed-state cache holding a hash
+#define FAILED_STATE_BUCKET(failedStates, hash) \
+  (&((failedStates)->entries[((hash) & ((failedStates)->numBuckets - 1)) * \
+                             FAILED_STATE_BUCKET_SIZE]))
+// Number of bytes in a bucket of the failed-state cache
+#define FAILED_STATE_BUCKET_BYTES (FAILED_STATE_BUCKET_SIZE * \
+                                   sizeof(unsigned long long))
 
 // Calculate the minimum of two numbers
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 // Calculate the maximum of two numbers
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 
+// Names of the types of constraints, as written in a solver's counters
+char* constraintTypeNames[NUM_CONSTRAINT_TYPES] = {
+  "LINE", "PLUS", "MINUS", "MULTIPLY", "DIVIDE", "SINGLE", "TABLE"
+};
+
+// Names of the performance counters, as printed
+char* perfCounterNames[NUM_PERF_COUNTERS] = {
+  "Cycles", "Instructions", "L1D Read Misses", "LLC Misses",
+  "Branch Mispredicts"
+};
+
+#ifdef PERF_COUNTERS
+// Type and config of the perf event each performance counter counts
+unsigned int perfCounterTypes[NUM_PERF_COUNTERS] = {
+  PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+  PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+};
+unsigned long long perfCounterConfigs[NUM_PERF_COUNTERS] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+  PERF_COUNT_HW_CACHE_MISSES,
+  PERF_COUNT_HW_BRANCH_MISSES
+};
+#endif
+
+
+// Given an input file name, create a solver with the puzzle's cells and
+// constraints initialized
+kenken_solver_t* createSolver(char* file) {
+  FILE* in;
+  kenken_solver_t* solver;
 
-// Max number by multiplying
-long* maxMultiply;
+  // Read in file
+  if (!(in = fopen(file, "r")))
+    unixError("Failed to open input file");
 
+  solver = readSolver(in);
 
-// Update constraint from having a cell with value oldCellValue to having the
-// cell assigned newCellValue (valid cell values include UNASSIGNED_VALUE).
-inline void updateConstraint(cell_t* cells, constraint_t* constraint,
-                             int oldCellValue, int newCellValue);
-
-// Funtions to initialize line constraints
-void initRowConstraint(cell_t* cells, constraint_t* constraints,
-                       int index, int col);
-void initColumnConstraint(cell_t* cells, constraint_t* constraints,
-                          int index, int col);
-
-// Functions to initialize cell's possibles in given constraint
-void initLineCells(cell_t* cells, celllist_t* cellList);
-void initPlusCells(cell_t* cells, celllist_t* cellList, long value,
-                   int numCells);
-void initMinusCells(cell_t* cells, celllist_t* cellList, long value);
-void initMultiplyCells(cell_t* cells, celllist_t* cellList, long value,
-                       int numCells);
-void initDivideCells(cell_t* cells, celllist_t* cellList, long value);
-void initSingleCells(cell_t* cells, celllist_t* cellList, long value);
-
-// Helper functions used when updating cell's possibles
-inline void updatePlusCells(cell_t* cells, celllist_t* cellList, long oldValue,
-                            int oldNumCells, long newValue, int newNumCells);
-inline void initMinusCellsHelper(cell_t* cells, celllist_t* cellList,
-                                 long value, char markPossible);
-inline void initPartialMinusCells(cell_t* cells, celllist_t* cellList,
-                                  long value, int cellValue, char markPossible);
-inline void updateMultiplyCells(cell_t* cells, celllist_t* cellList,
-                                long oldValue, int oldNumCells, long newValue,
-                                int newNumCells);
-inline void initDivideCellsHelper(cell_t* cells, celllist_t* cellList,
-                                  long value, char markPossible);
-inline void initPartialDivideCells(cell_t* cells, celllist_t* cellList,
-                                  long value, int cellValue, char markPossible);
-inline void notifyCellsOfChange(cell_t* cells, celllist_t* cellList, int value,
-                                char markPossible);
-inline void notifyCellsOfChanges(cell_t* cells, celllist_t* cellList,
-                                 int start, int end, char markPossible);
-
-// Cell list functions
-inline void initList(celllist_t* cellList);
-inline void addNode(celllist_t* cellList, int node);
-inline void removeNode(celllist_t* cellList, int node);
-
-// Miscellaneous functions
-void readLine(FILE* in, char* lineBuf);
-
-
-// Given an input file name, initialize cells and constraints and global
-// variables. Note, this should only be called once at beginning of program.
-// The constraints and cells results can be memcpy'ed if need be.
-void initialize(char* file, cell_t** cellsPtr, constraint_t** constraintsPtr) {
-  FILE* in;
+  // Close file
+  fclose(in);
+
+  return solver;
+}
+
+// Read a puzzle from a stream, and create a solver for it
+kenken_solver_t* readSolver(FILE* in) {
   char type, lineBuf[MAX_LINE_LEN];
   char* ptr;
-  int i, x, y;
+  int i, x, y, N, listOffset, next;
   long value;
   constraint_t* constraints, *constraint;
-  cell_t* cells;
+  cells_t* cells;
   celllist_t* cellList;
+  kenken_solver_t* solver;
 
-  // Read in file
-  if (!(in = fopen(file, "r")))
-    unixError("Failed to open input file");
+  solver = (kenken_solver_t*)calloc(sizeof(kenken_solver_t), 1);
+  if (!solver)
+    unixError("Failed to allocate memory for the solver");
 
   // Read in problem size and number of constraints
   readLine(in, lineBuf);
-  N = atoi(lineBuf);
+  N = solver->N = atoi(lineBuf);
   if (N > MAX_PROBLEM_SIZE)
     appError("Problem size too large");
 
   readLine(in, lineBuf);
   // N row constraints + N column constraints + number of block constraints
-  numConstraints = 2 * N + atoi(lineBuf);
+  solver->numConstraints = 2 * N + atoi(lineBuf);
+
+  // Use vector kernels if the processor supports them
+#ifdef AVX2_KERNELS
+  solver->useAvx2 = __builtin_cpu_supports("avx2");
+#endif
 
   // Allocate space for cells and constraints
-  totalNumCells = N * N;
-  cells = (cell_t*)calloc(sizeof(cell_t), totalNumCells);
-  if (!cells)
-    unixError("Failed to allocate memory for the cells");
+  solver->totalNumCells = N * N;
+  cells = solver->cells = allocateCells(solver);
 
-  constraints = (constraint_t*)calloc(sizeof(constraint_t), numConstraints);
+  constraints = (constraint_t*)calloc(sizeof(constraint_t),
+                                      solver->numConstraints);
   if (!constraints)
     unixError("Failed to allocate memory for the constraints");
+  solver->constraints = constraints;
 
-  maxMultiply = (long*)calloc(sizeof(long), totalNumCells);
-  if (!maxMultiply)
+  solver->maxMultiply = (long*)calloc(sizeof(long), solver->totalNumCells);
+  if (!solver->maxMultiply)
     unixError("Failed to allocate memory for the max multiply array");
 
   // Initialize max multiply array
-  for (i = 0, value = 1; i < totalNumCells; i++) {
-    maxMultiply[i] = value;
+  for (i = 0, value = 1; i < solver->totalNumCells; i++) {
+    solver->maxMultiply[i] = value;
 
     if (value > LONG_MAX / N)
       break;
     value *= N;
   }
-  for (; i < totalNumCells; i++)
-    maxMultiply[i] = LONG_MAX;
+  for (; i < solver->totalNumCells; i++)
+    solver->maxMultiply[i] = LONG_MAX;
+
+  solver->cageTables = (cagetable_t**)calloc(sizeof(cagetable_t*),
+                                             solver->numConstraints);
+  solver->cagePositions = (int*)calloc(sizeof(int), solver->totalNumCells);
+  if (!solver->cageTables || !solver->cagePositions)
+    unixError("Failed to allocate memory for the cage tables");
+
+  // All cells start with no possibles, and nothing ruled out by propagation
+  solver->useBuckets = (N >= MIN_BUCKETS_PROBLEM_SIZE);
+  solver->linePropagation = (N >= MIN_PROPAGATION_PROBLEM_SIZE) ?
+                            SUBSET_PROPAGATION : NO_PROPAGATION;
+  for (i = 0; i < solver->totalNumCells; i++) {
+    addToBucket(solver, i);
+    cells->masks[DEDUCTION_MASK_INDEX][i] = RANGE_MASK(1, N);
+  }
 
   // Initialize row and column constraints
   for (i = 0; i < N; i++) {
-    initRowConstraint(cells, constraints, i, i);
-    initColumnConstraint(cells, constraints, i + N, i);
+    initRowConstraint(solver, i, i);
+    initColumnConstraint(solver, i + N, i);
   }
 
-  // Initialize block constraints
-  for (i = 2 * N; i < numConstraints; i++) {
+  // Initialize block constraints, whose cell lists follow the row and column
+  // cell lists in the list pool
+  listOffset = 2 * solver->totalNumCells;
+  for (i = 2 * N; i < solver->numConstraints; i++) {
     readLine(in, lineBuf);
     constraint = &(constraints[i]);
     cellList = &(constraint->cellList);
 
-    // Read in type
-    ptr = strtok(lineBuf, " ");
-    type = *ptr;
+    // Read in type
+    ptr = strtok(lineBuf, " ");
+    type = *ptr;
+
+    // Read in value
+    ptr = strtok(NULL, " ");
+    value = atol(ptr);
+
+    constraint->value = value;
+    constraint->index = i;
+    constraint->maskIndex = BLOCK_CONSTRAINT_INDEX;
+
+    // Read in cell coordinates
+    initList(cellList, listOffset);
+    while ((ptr = strtok(NULL, ", "))) {
+      x = atoi(ptr);
+      ptr = strtok(NULL, ", ");
+      y = atoi(ptr);
+
+      // Every cell is in exactly one block constraint
+      if (listOffset + cellList->size >=
+          NUM_CELL_CONSTRAINTS * solver->totalNumCells)
+        appError("Malformed constraint in input file");
+
+      // Add block constraint to cell
+      addNode(solver, constraint, GET_CELL(x, y));
+      cells->constraintIndexes[BLOCK_CONSTRAINT_INDEX][GET_CELL(x, y)] = i;
+    }
+    listOffset += cellList->size;
+
+    // Plus and multiply cages use a table of their tuples, unless they have
+    // too many cells or tuples
+    if ((type == '+' || type == 'x') &&
+        (solver->cageTables[i] = createCageTable(solver, constraint,
+                                                 (type == '+') ? PLUS :
+                                                 MULTIPLY, value))) {
+      constraint->type = TABLE;
+      initTableCells(solver, constraint);
+      continue;
+    }
+
+    // Initialize constraint's type and possibles
+    switch (type) {
+      case '+':
+        constraint->type = PLUS;
+        initPlusCells(solver, constraint, value, constraint->cellList.size);
+        break;
+      case '-':
+        constraint->type = MINUS;
+        initMinusCells(solver, constraint, value);
+        break;
+      case 'x':
+        constraint->type = MULTIPLY;
+        initMultiplyCells(solver, constraint, value, constraint->cellList.size);
+        break;
+      case '/':
+        constraint->type = DIVIDE;
+        initDivideCells(solver, constraint, value);
+        break;
+      case '!':
+        constraint->type = SINGLE;
+        initSingleCells(solver, constraint, value);
+        break;
+      default:
+        appError("Malformed constraint in input file");
+    }
+  }
+
+  for (i = 0; i < solver->numConstraints; i++)
+    constraints[i].weight = 1;
+
+  solver->constraintCells = (cellset_t*)calloc(sizeof(cellset_t),
+                                               solver->numConstraints);
+  if (!solver->constraintCells)
+    unixError("Failed to allocate memory for the constraints' cells");
+
+  for (i = 0; i < solver->totalNumCells; i++) {
+    for (x = 0; x < NUM_CELL_CONSTRAINTS; x++)
+      ADD_TO_CELL_SET(&(solver->constraintCells[
+          cells->constraintIndexes[x][i]]), i);
+  }
+
+  // Cells can be given a value by lines like "= 3 0,2" after the cages, as
+  // written by the split tool, leaving only that value possible
+  while ((next = getc(in)) == '=') {
+    readLine(in, lineBuf);
+    if (sscanf(lineBuf, "%ld %d,%d", &value, &x, &y) != 3 ||
+        value < 1 || value > N || x < 0 || x >= N || y < 0 || y >= N)
+      appError("Malformed given value in input file");
+
+    i = GET_CELL(x, y);
+    setCellMask(solver, i, DEDUCTION_MASK_INDEX,
+                cells->masks[DEDUCTION_MASK_INDEX][i] & VALUE_MASK(value));
+  }
+  if (next != EOF)
+    ungetc(next, in);
+
+  queueAllLines(solver);
+  return solver;
+}
+
+// Allocate an empty puzzle text
+puzzletext_t* allocatePuzzleText() {
+  puzzletext_t* puzzle = (puzzletext_t*)malloc(sizeof(puzzletext_t));
+  if (!puzzle)
+    unixError("Failed to allocate memory for the puzzle text");
+
+  puzzle->capacity = INITIAL_TEXT_CAPACITY;
+  puzzle->text = (char*)malloc(puzzle->capacity);
+  if (!puzzle->text)
+    unixError("Failed to allocate memory for the puzzle text");
+  puzzle->size = 0;
+  return puzzle;
+}
+
+// Free a puzzle text
+void freePuzzleText(puzzletext_t* puzzle) {
+  free(puzzle->text);
+  free(puzzle);
+}
+
+// Read the text of the next puzzle in a stream into puzzle, skipping to the
+// next line holding only the problem size. Returns 0 if there are no puzzles
+// left.
+int readPuzzleText(FILE* in, puzzletext_t* puzzle) {
+  int i, numLines, value, next;
+  char extra;
+  char lineBuf[MAX_LINE_LEN];
+
+  // Skip blank lines and the answers puzzle files can end with (the answer of
+  // a 1 x 1 puzzle looks like a problem size, so can not be skipped)
+  do {
+    if (!fgets(lineBuf, MAX_LINE_LEN, in))
+      return 0;
+  } while (sscanf(lineBuf, "%d %c", &value, &extra) != 1);
+
+  puzzle->size = 0;
+  appendPuzzleLine(puzzle, lineBuf);
+
+  // Read in number of constraints, followed by the constraints
+  for (i = 0, numLines = 1; i < numLines; i++) {
+    if (!fgets(lineBuf, MAX_LINE_LEN, in))
+      appError("Incomplete puzzle in input file");
+
+    appendPuzzleLine(puzzle, lineBuf);
+    if (i == 0)
+      numLines += atoi(lineBuf);
+  }
+
+  // Followed by any given values
+  while ((next = getc(in)) == '=') {
+    lineBuf[0] = next;
+    if (!fgets(&(lineBuf[1]), MAX_LINE_LEN - 1, in))
+      appError("Incomplete puzzle in input file");
+    appendPuzzleLine(puzzle, lineBuf);
+  }
+  if (next != EOF)
+    ungetc(next, in);
+
+  return 1;
+}
+
+// Append a line to the text of a puzzle, growing the text if full
+void appendPuzzleLine(puzzletext_t* puzzle, char* line) {
+  size_t length = strlen(line);
+
+  if (puzzle->size + length + 1 > puzzle->capacity) {
+    while (puzzle->size + length + 1 > puzzle->capacity)
+      puzzle->capacity *= 2;
+
+    puzzle->text = (char*)realloc(puzzle->text, puzzle->capacity);
+    if (!puzzle->text)
+      unixError("Failed to allocate memory for the puzzle text");
+  }
+
+  memcpy(&(puzzle->text[puzzle->size]), line, length + 1);
+  puzzle->size += length;
+}
+
+// Create a clone of a solver, with its own copy of the cells and constraints
+// and sharing the lookup tables
+kenken_solver_t* cloneSolver(kenken_solver_t* solver) {
+  kenken_solver_t* clone = (kenken_solver_t*)malloc(sizeof(kenken_solver_t));
+  if (!clone)
+    unixError("Failed to allocate memory for the solver clone");
+
+  memcpy(clone, solver, sizeof(kenken_solver_t));
+  clone->isClone = 1;
+  clone->trail = NULL;
+  clone->stats = NULL;
+  if (solver->nogoods)
+    clone->nogoods = allocateNogoods();
+
+  clone->cells = allocateCells(clone);
+  clone->constraints = (constraint_t*)malloc(sizeof(constraint_t) *
+                                             clone->numConstraints);
+  if (!clone->constraints)
+    unixError("Failed to allocate memory for the solver clone's constraints");
+
+  copySolver(clone, solver);
+  return clone;
+}
+
+// Copy the state of the cells and constraints of src to dest
+void copySolver(kenken_solver_t* dest, kenken_solver_t* src) {
+  memcpy(dest->cells->data, src->cells->data, src->cellsDataSize);
+  memcpy(dest->constraints, src->constraints,
+         sizeof(constraint_t) * src->numConstraints);
+  dest->stateHash = src->stateHash;
+}
+
+// Free a solver, and the lookup tables if it is not a clone
+void freeSolver(kenken_solver_t* solver) {
+  int i;
+
+  if (!solver->isClone) {
+    free(solver->maxMultiply);
+
+    for (i = 0; i < solver->numConstraints; i++) {
+      if (solver->cageTables[i])
+        freeCageTable(solver->cageTables[i]);
+    }
+    free(solver->cageTables);
+    free(solver->cagePositions);
+    free(solver->constraintCells);
+    free(solver->stateKeys);
+    if (solver->failedStates)
+      freeFailedStates(solver->failedStates);
+  }
+
+  free(solver->nogoods);
+  freeCells(solver->cells);
+  free(solver->constraints);
+  free(solver);
+}
+
+// Allocate space for the cells of a solver
+cells_t* allocateCells(kenken_solver_t* solver) {
+  int i;
+  char* data;
+  cells_t* cells;
+  int totalNumCells = solver->totalNumCells;
+
+  // Pad each array, so the AVX2 kernel can load a full vector from the start
+  // of the last row
+  size_t intsSize = ALIGN_UP((totalNumCells + 16) * sizeof(int));
+  size_t masksSize = ALIGN_UP((totalNumCells + 16) * sizeof(domain_t));
+  size_t bucketsSize = ALIGN_UP((solver->N + 1) * BUCKET_WORDS *
+                                sizeof(unsigned long long));
+  size_t listCellsSize = ALIGN_UP(NUM_CELL_CONSTRAINTS * totalNumCells *
+                                  sizeof(int));
+  size_t valueOrdersSize = ALIGN_UP(VALUE_ORDER_SIZE * totalNumCells);
+  size_t valueCellsSize = ALIGN_UP(NUM_CELL_LINES * solver->N *
+                                   (MAX_PROBLEM_SIZE + 1) * sizeof(int));
+  size_t assignTimesSize = ALIGN_UP(totalNumCells * sizeof(long long));
+  size_t cellSetsSize = (1 + totalNumCells) * sizeof(cellset_t);
+
+  solver->cellsDataSize = (2 + 2 * NUM_CELL_CONSTRAINTS + NUM_CELL_LINES) *
+                          intsSize + NUM_CELL_MASKS * masksSize +
+                          bucketsSize + listCellsSize + valueOrdersSize +
+                          valueCellsSize + assignTimesSize + cellSetsSize;
+
+  cells = (cells_t*)malloc(sizeof(cells_t));
+  if (!cells)
+    unixError("Failed to allocate memory for the cells");
+
+  if (posix_memalign(&(cells->data), CELLS_ALIGNMENT, solver->cellsDataSize))
+    appError("Failed to allocate memory for the cells data");
+  memset(cells->data, 0, solver->cellsDataSize);
+
+  data = (char*)cells->data;
+  cells->values = (int*)data;
+  cells->numPossibles = (int*)(data += intsSize);
+  for (i = 0; i < NUM_CELL_CONSTRAINTS; i++)
+    cells->constraintIndexes[i] = (int*)(data += intsSize);
+  for (i = 0; i < NUM_CELL_CONSTRAINTS; i++)
+    cells->listPositions[i] = (int*)(data += intsSize);
+  for (i = 0; i < NUM_CELL_LINES; i++)
+    cells->matchedValues[i] = (int*)(data += intsSize);
+  data += intsSize;
+  for (i = 0; i < NUM_CELL_MASKS; i++, data += masksSize)
+    cells->masks[i] = (domain_t*)data;
+  cells->buckets = (unsigned long long*)data;
+  cells->listCells = (int*)(data += bucketsSize);
+  cells->valueOrders = (unsigned char*)(data += listCellsSize);
+  cells->valueCells = (int*)(data += valueOrdersSize);
+  cells->assignTimes = (long long*)(data += valueCellsSize);
+  cells->assignedCells = (cellset_t*)(data += assignTimesSize);
+  cells->deductionCells = cells->assignedCells + 1;
+
+  return cells;
+}
+
+// Free the cells
+void freeCells(cells_t* cells) {
+  free(cells->data);
+  free(cells);
+}
+
+// Allocate an empty trail
+trail_t* allocateTrail() {
+  trail_t* trail = (trail_t*)malloc(sizeof(trail_t));
+  if (!trail)
+    unixError("Failed to allocate memory for the trail");
+
+  trail->size = 0;
+  trail->capacity = INITIAL_TRAIL_CAPACITY;
+  trail->entries = (trailentry_t*)malloc(sizeof(trailentry_t) *
+                                         trail->capacity);
+  if (!trail->entries)
+    unixError("Failed to allocate memory for the trail entries");
+
+  return trail;
+}
+
+// Free a trail
+void freeTrail(trail_t* trail) {
+  free(trail->entries);
+  free(trail);
+}
+
+// Undo the changes recorded in the trail until it is back to size mark
+void undoTrail(kenken_solver_t* solver, trail_t* trail, int mark) {
+  cells_t* cells = solver->cells;
+  constraint_t* constraints = solver->constraints;
+  trailentry_t* entry;
+  trail_t* solverTrail = solver->trail;
+
+  // Don't record the changes made while undoing
+  solver->trail = NULL;
+
+  while (trail->size > mark) {
+    entry = &(trail->entries[--(trail->size)]);
+
+    switch (entry->type) {
+      case TRAIL_MASK:
+        cells->masks[entry->maskIndex][entry->index] =
+            (domain_t)entry->oldValue;
+        break;
+      case TRAIL_NUM_POSSIBLES:
+        updateNumPossibles(solver, entry->index, (int)entry->oldValue);
+        break;
+      case TRAIL_VALUE:
+        if (solver->failedStates)
+          updateStateHash(solver, entry->index, cells->values[entry->index],
+                          (int)entry->oldValue);
+        cells->values[entry->index] = (int)entry->oldValue;
+        if (entry->oldValue == UNASSIGNED_VALUE)
+          REMOVE_FROM_CELL_SET(cells->assignedCells, entry->index);
+        else
+          ADD_TO_CELL_SET(cells->assignedCells, entry->index);
+        break;
+      case TRAIL_CONSTRAINT_VALUE:
+        constraints[entry->index].value = entry->oldValue;
+        break;
+      case TRAIL_REMOVE_CELL:
+        addToConstraints(solver, entry->index);
+        break;
+      case TRAIL_ADD_CELL:
+        removeFromConstraints(solver, entry->index);
+        break;
+      case TRAIL_DEDUCTION_CELLS:
+        cells->deductionCells[entry->index].words[entry->maskIndex] =
+            (unsigned long long)entry->oldValue;
+        break;
+    }
+  }
+
+  solver->trail = solverTrail;
+}
+
+// Make deductions from the line constraints queued for propagation until no
+// more can be made, recording the changes in trail
+int propagate(kenken_solver_t* solver, trail_t* trail) {
+  int line, consistent = 1;
+  constraint_t* constraint;
+  trail_t* solverTrail = solver->trail;
+
+  if (solver->linePropagation == NO_PROPAGATION)
+    return 1;
+
+  // Deductions queue the lines of the cells they change, so keep going until
+  // the queue is empty. Lines left in the queue on failure are harmless.
+  solver->trail = trail;
+  while (consistent && solver->lineQueue) {
+    line = __builtin_ctzll(solver->lineQueue);
+    solver->lineQueue &= solver->lineQueue - 1;
+    constraint = &(solver->constraints[line]);
+    solver->propagatingLine = constraint;
+    solver->lineExplained = 0;
+    if (solver->stats)
+      solver->stats->linePropagations++;
+    consistent = (solver->linePropagation == MATCHING_PROPAGATION) ?
+                 matchLine(solver, constraint) :
+                 propagateLine(solver, constraint);
+  }
+
+  if (!consistent) {
+    constraint->weight++;
+    if (solver->stats)
+      solver->stats->lineFailures++;
+    if (solver->useBackjumping)
+      explainLine(solver, constraint, &(solver->failure));
+  }
+
+  solver->trail = solverTrail;
+  return consistent;
+}
+
+// Queue all line constraints for propagation
+void queueAllLines(kenken_solver_t* solver) {
+  solver->lineQueue = (1ULL << (2 * solver->N)) - 1;
+}
+
+// Get number of possibles for a specific cell
+inline int getNumPossibles(kenken_solver_t* solver, int cellIndex) {
+  cells_t* cells = solver->cells;
+  return cells->numPossibles[cellIndex];
+}
+
+// Get the possible values of a cell
+inline domain_t getPossibles(kenken_solver_t* solver, int cellIndex) {
+  return POSSIBLES(solver->cells->masks, cellIndex);
+}
+
+// Apply a value to a specific cell, updating its constraints
+inline void applyValue(kenken_solver_t* solver, int cellIndex, int value) {
+  cells_t* cells = solver->cells;
+  constraint_t* constraints = solver->constraints;
+  int i;
+  constraint_t* constraint;
+
+  setValue(solver, cellIndex, value);
+
+  // Remove cell from its constraints, and update constraints
+  removeFromConstraints(solver, cellIndex);
+  for (i = 0; i < NUM_CELL_CONSTRAINTS; i++) {
+    constraint = &(constraints[cells->constraintIndexes[i][cellIndex]]);
+    updateConstraint(solver, constraint, cellIndex, UNASSIGNED_VALUE, value);
+  }
+}
+
+// Get the next cell to fill in, remove it from its constraints, and return its
+// index
+inline int getNextCellToFill(kenken_solver_t* solver) {
+  return getNextCellToFillN(solver, INT_MAX);
+}
+
+// Same as getNextCellToFill, except it imposes a max number of possibles
+// allowed for the chosen cell, returning TOO_MANY_POSSIBLES if broken.
+inline int getNextCellToFillN(kenken_solver_t* solver, int maxPossibles) {
+  int minIndex, minPossibles;
+
+  // Find the unassigned cell with the mininum number of possibilities, unless
+  // using another cell order
+  if (solver->cellOrder != MIN_POSSIBLES_ORDER)
+    minIndex = findBestCellInOrder(solver, &minPossibles);
+  else if (solver->useBuckets)
+    minIndex = findMinCellInBuckets(solver, &minPossibles);
+  else
+    minIndex = findMinCellByScan(solver, &minPossibles);
+
+  // Fail early if found unassigned cell with no possibilities
+  if (minPossibles == 0) {
+    if (solver->stats) {
+      if (!solver->cells->masks[BLOCK_CONSTRAINT_INDEX][minIndex])
+        solver->stats->cageViolations++;
+      else
+        solver->stats->emptyDomains++;
+    }
+    if (solver->useBackjumping) {
+      CLEAR_CELL_SET(&(solver->failure));
+      explainCell(solver, minIndex, &(solver->failure));
+    }
+    return IMPOSSIBLE_STATE;
+  }
+
+  if (minPossibles > maxPossibles)
+    return TOO_MANY_POSSIBLES;
+
+  if (minIndex < 0)
+    return IMPOSSIBLE_STATE;
+
+  // Remove cell from its constraints in preparation for updating
+  removeFromConstraints(solver, minIndex);
+  return minIndex;
+}
+
+// Find the lowest index cell in the first non-empty bucket, returning -1 if
+// there are no unassigned cells
+inline int findMinCellInBuckets(kenken_solver_t* solver, int* minPossiblesPtr) {
+  cells_t* cells = solver->cells;
+  int i, numPossibles;
+  unsigned long long* bucket = cells->buckets;
+
+  for (numPossibles = 0; numPossibles <= solver->N; numPossibles++) {
+    for (i = 0; i < BUCKET_WORDS; i++) {
+      if (bucket[i]) {
+        *minPossiblesPtr = numPossibles;
+        return 64 * i + __builtin_ctzll(bucket[i]);
+      }
+    }
+
+    bucket += BUCKET_WORDS;
+  }
+
+  *minPossiblesPtr = INT_MAX;
+  return -1;
+}
+
+// Find the lowest index unassigned cell with the minimum number of possibles
+// by scanning all cells, returning -1 if there are no unassigned cells. Stops
+// early if it finds a cell with no possibles.
+inline int findMinCellByScan(kenken_solver_t* solver, int* minPossiblesPtr) {
+  cells_t* cells = solver->cells;
+  int i, numPossibles;
+  int minIndex = -1, minPossibles = INT_MAX;
+  int* values = cells->values;
+
+  for (i = 0; i < solver->totalNumCells; i++) {
+    // Skip assigned cells
+    if (values[i] != UNASSIGNED_VALUE)
+      continue;
+
+    numPossibles = cells->numPossibles[i];
+
+    if (numPossibles < minPossibles) {
+      minIndex = i;
+      minPossibles = numPossibles;
+
+      if (numPossibles == 0)
+        break;
+    }
+  }
+
+  *minPossiblesPtr = minPossibles;
+  return minIndex;
+}
+
+// Find the best unassigned cell in the solver's cell order, returning -1 if
+// there are no unassigned cells. Stops early if it finds a cell with no
+// possibles, which counts as a failure of its constraints, or one possible.
+inline int findBestCellInOrder(kenken_solver_t* solver, int* minPossiblesPtr) {
+  cells_t* cells = solver->cells;
+  constraint_t* constraints = solver->constraints;
+  int i, k, numPossibles, weight, better;
+  int bestIndex = -1, bestPossibles = INT_MAX, bestWeight = 0;
+  int* values = cells->values;
+
+  for (i = 0; i < solver->totalNumCells; i++) {
+    // Skip assigned cells
+    if (values[i] != UNASSIGNED_VALUE)
+      continue;
+
+    numPossibles = cells->numPossibles[i];
+    if (numPossibles <= 1) {
+      if (numPossibles == 0) {
+        for (k = 0; k < NUM_CELL_CONSTRAINTS; k++)
+          constraints[cells->constraintIndexes[k][i]].weight++;
+      }
+
+      bestIndex = i;
+      bestPossibles = numPossibles;
+      break;
+    }
+
+    weight = getCellWeight(solver, i);
+    if (solver->cellOrder == CAGE_ORDER)
+      better = numPossibles < bestPossibles ||
+               (numPossibles == bestPossibles && weight > bestWeight);
+    else
+      better = bestIndex < 0 ||
+               (long)numPossibles * bestWeight < (long)bestPossibles * weight;
+
+    if (better) {
+      bestIndex = i;
+      bestPossibles = numPossibles;
+      bestWeight = weight;
+    }
+  }
+
+  *minPossiblesPtr = bestPossibles;
+  return bestIndex;
+}
+
+// Weight of an unassigned cell in the solver's cell order, where cells with
+// more weight are chosen first among cells with as many possibles (or for
+// dom/deg and dom/wdeg, the possibles are divided by the weight)
+inline int getCellWeight(kenken_solver_t* solver, int cellIndex) {
+  cells_t* cells = solver->cells;
+  int k, numOthers, weight = 0;
+  constraint_t* constraint;
+
+  for (k = 0; k < NUM_CELL_CONSTRAINTS; k++) {
+    constraint = &(solver->constraints[cells->constraintIndexes[k][cellIndex]]);
+    numOthers = constraint->cellList.size - 1;
+
+    switch (solver->cellOrder) {
+      case CAGE_ORDER:
+        if (k == BLOCK_CONSTRAINT_INDEX)
+          weight = -numOthers;
+        break;
+      case DOM_DEG_ORDER:
+        weight += numOthers;
+        break;
+      case DOM_WDEG_ORDER:
+        if (numOthers > 0)
+          weight += constraint->weight;
+        break;
+      default:
+        break;
+    }
+  }
+
+  // Cells with no unassigned neighbours divide their possibles by 1
+  if (solver->cellOrder != CAGE_ORDER && weight == 0)
+    weight = 1;
+  return weight;
+}
+
+// Apply and return next value for the cell currently filling in
+inline int applyNextValue(kenken_solver_t* solver, int cellIndex,
+                          int previousValue) {
+  cells_t* cells = solver->cells;
+  constraint_t* constraints = solver->constraints;
+  int i, value;
+  constraint_t* constraint;
+  domain_t possibles;
+  domain_t** masks = cells->masks;
+
+  // Possible values less than the previous value, tried from largest down,
+  // unless using another value order
+  if (solver->valueOrder != DESCENDING_VALUE_ORDER)
+    value = getNextValueInOrder(solver, cellIndex, previousValue);
+  else {
+    possibles = POSSIBLES(masks, cellIndex);
+    if (previousValue != UNASSIGNED_VALUE)
+      possibles &= VALUE_MASK(previousValue) - 1;
+    value = possibles ? HIGHEST_VALUE(possibles) : UNASSIGNED_VALUE;
+  }
+
+  if (value != UNASSIGNED_VALUE) {
+    setValue(solver, cellIndex, value);
+
+    for (i = 0; i < NUM_CELL_CONSTRAINTS; i++) {
+      constraint = &(constraints[cells->constraintIndexes[i][cellIndex]]);
+      updateConstraint(solver, constraint, cellIndex, previousValue, value);
+    }
+
+    return value;
+  }
+
+  unassignCell(solver, cellIndex, previousValue);
+  return UNASSIGNED_VALUE;
+}
+
+// Unassign a cell's value, and add the cell back to its constraints
+inline void unassignCell(kenken_solver_t* solver, int cellIndex, int value) {
+  cells_t* cells = solver->cells;
+  constraint_t* constraints = solver->constraints;
+  int i;
+  constraint_t* constraint;
+
+  for (i = 0; i < NUM_CELL_CONSTRAINTS; i++) {
+    constraint = &(constraints[cells->constraintIndexes[i][cellIndex]]);
+    updateConstraint(solver, constraint, cellIndex, value, UNASSIGNED_VALUE);
+  }
+
+  // Add cell back to its constraints after updating them so cell's possibles
+  // are not changed during the updates
+  addToConstraints(solver, cellIndex);
+
+  setValue(solver, cellIndex, UNASSIGNED_VALUE);
+}
+
+// Get the values applyNextValue would still try for a cell after value, in the
+// order it would try them, given the cell's possibles before its first value
+// was applied. Returns the number of values.
+int getUntriedValues(kenken_solver_t* solver, int cellIndex,
+                     domain_t possibles, int value, int* values) {
+  unsigned char* order;
+  int i, numValues = 0;
+
+  if (solver->valueOrder != DESCENDING_VALUE_ORDER) {
+    order = &(solver->cells->valueOrders[cellIndex * VALUE_ORDER_SIZE]);
+    for (i = 0; order[i] != value; i++);
+    for (i++; order[i] != UNASSIGNED_VALUE; i++)
+      values[numValues++] = order[i];
+    return numValues;
+  }
+
+  possibles &= VALUE_MASK(value) - 1;
+  while (possibles) {
+    values[numValues] = HIGHEST_VALUE(possibles);
+    possibles &= ~VALUE_MASK(values[numValues++]);
+  }
+
+  return numValues;
+}
+
+// Get the next value of a cell after previousValue in the solver's value
+// order, or UNASSIGNED_VALUE if there are no more. The cell's order is found
+// on the first call for the cell, when previousValue is UNASSIGNED_VALUE, and
+// its possibles don't change until its last value is tried.
+inline int getNextValueInOrder(kenken_solver_t* solver, int cellIndex,
+                               int previousValue) {
+  cells_t* cells = solver->cells;
+  unsigned char* order = &(cells->valueOrders[cellIndex * VALUE_ORDER_SIZE]);
+  int i, value, cost, numValues = 0;
+  int costs[MAX_PROBLEM_SIZE];
+  domain_t possibles;
+
+  if (previousValue != UNASSIGNED_VALUE) {
+    for (i = 0; order[i] != previousValue; i++);
+    return order[i + 1];
+  }
+
+  // Shuffle the values, inserting each one at a random position
+  if (solver->valueOrder == RANDOM_VALUE_ORDER) {
+    possibles = POSSIBLES(cells->masks, cellIndex);
+    for (; possibles; possibles &= ~VALUE_MASK(value)) {
+      value = HIGHEST_VALUE(possibles);
+      i = rand_r(&(solver->seed)) % (numValues + 1);
+      order[numValues++] = order[i];
+      order[i] = value;
+    }
+
+    order[numValues] = UNASSIGNED_VALUE;
+    return order[0];
+  }
+
+  // Sort the values by cost, keeping values with equal costs largest first
+  possibles = POSSIBLES(cells->masks, cellIndex);
+  for (; possibles; possibles &= ~VALUE_MASK(value)) {
+    value = HIGHEST_VALUE(possibles);
+    cost = getValueCost(solver, cellIndex, value);
+
+    for (i = numValues; i > 0 && costs[i - 1] > cost; i--) {
+      order[i] = order[i - 1];
+      costs[i] = costs[i - 1];
+    }
+
+    order[i] = value;
+    costs[i] = cost;
+    numValues++;
+  }
+
+  order[numValues] = UNASSIGNED_VALUE;
+  return order[0];
+}
+
+// Number of possibles that assigning value to a cell removes from the other
+// unassigned cells in its row and column, and (for table cages) its cage,
+// assuming no other cell in the cage is assigned
+inline int getValueCost(kenken_solver_t* solver, int cellIndex, int value) {
+  cells_t* cells = solver->cells;
+  domain_t** masks = cells->masks;
+  int i, k, cost = 0;
+  constraint_t* constraint;
+  cagetable_t* table;
+  domain_t* supportedMasks;
+  int* listCells;
+
+  for (k = 0; k < NUM_CELL_CONSTRAINTS; k++) {
+    constraint = &(solver->constraints[cells->constraintIndexes[k][cellIndex]]);
+    listCells = &(cells->listCells[constraint->cellList.offset]);
+
+    if (constraint->type == LINE) {
+      for (i = 0; i < constraint->cellList.size; i++)
+        cost += (POSSIBLES(masks, listCells[i]) & VALUE_MASK(value)) != 0;
+    }
+    else if (constraint->type == TABLE) {
+      table = solver->cageTables[constraint->index];
+      supportedMasks = SINGLE_MASKS(table, solver->cagePositions[cellIndex],
+                                    value);
+      for (i = 0; i < constraint->cellList.size; i++)
+        cost += POPCOUNT(POSSIBLES(masks, listCells[i]) &
+                         ~supportedMasks[solver->cagePositions[listCells[i]]]);
+    }
+  }
+
+  return cost;
+}
+
+// Set conflict to the cells whose values caused the last failure in
+// propagate, getNextCellToFill or isFailedState
+void explainFailure(kenken_solver_t* solver, cellset_t* conflict) {
+  if (solver->useBackjumping)
+    *conflict = solver->failure;
+}
+
+// Check whether the value just applied to a cell completes a learned nogood,
+// setting conflict to the nogood's cells if so. Each nogood watching the value
+// moves its watch to a value its cell does not have, if there is one.
+int checkNogoods(kenken_solver_t* solver, int cellIndex, cellset_t* conflict) {
+  nogoods_t* nogoods = solver->nogoods;
+  int* values = solver->cells->values;
+  int i, slot, nextSlot;
+  nogood_t* nogood;
+
+  if (!solver->useBackjumping)
+    return 0;
+
+  for (slot = nogoods->heads[NOGOOD_LIST(cellIndex, values[cellIndex])];
+       slot >= 0; slot = nextSlot) {
+    nextSlot = nogoods->next[slot];
+    nogood = &(nogoods->nogoods[slot]);
+    for (i = 0; i < nogood->numCells &&
+         values[nogood->cellIndexes[i]] == nogood->values[i]; i++);
+
+    if (i < nogood->numCells) {
+      unwatchNogood(nogoods, slot);
+      nogood->watch = i;
+      watchNogood(nogoods, slot);
+      continue;
+    }
+
+    nogood->used = 1;
+    if (solver->stats)
+      solver->stats->nogoodFailures++;
+    CLEAR_CELL_SET(conflict);
+    for (i = 0; i < nogood->numCells; i++)
+      ADD_TO_CELL_SET(conflict, nogood->cellIndexes[i]);
+    return 1;
+  }
+
+  return 0;
+}
+
+// After the search from a cell's value fails with childConflict, add it to the
+// conflict of the cell's node, or jump over the node if the cell's value did
+// not cause the failure
+int backjump(kenken_solver_t* solver, int cellIndex, int value,
+             cellset_t* childConflict, cellset_t* conflict) {
+  int i;
+
+  if (!solver->useBackjumping)
+    return 0;
+
+  if (!IN_CELL_SET(childConflict, cellIndex)) {
+    unassignCell(solver, cellIndex, value);
+    *conflict = *childConflict;
+    return 1;
+  }
+
+  for (i = 0; i < CELL_SET_WORDS; i++)
+    conflict->words[i] |= childConflict->words[i];
+  REMOVE_FROM_CELL_SET(conflict, cellIndex);
+  return 0;
+}
+
+// After all of a cell's values failed, add the cells whose values removed its
+// other possibles to its node's conflict, and learn the conflict
+void learnConflict(kenken_solver_t* solver, int cellIndex,
+                   cellset_t* conflict) {
+  if (!solver->useBackjumping)
+    return;
+
+  explainCell(solver, cellIndex, conflict);
+  learnNogood(solver, conflict);
+}
+
+// Add to reasons the cells whose values removed possibles from an unassigned
+// cell. A value missing from one of its lines is explained by the line's cell
+// with the value, otherwise by the cells of its cage, and otherwise by the
+// cells explaining the cell's deductions.
+inline void addCellReasons(kenken_solver_t* solver, int cellIndex,
+                           cellset_t* reasons) {
+  cells_t* cells = solver->cells;
+  domain_t** masks = cells->masks;
+  int i, k;
+  int* valueCells;
+  domain_t missing, lineValues = RANGE_MASK(1, solver->N);
+  cellset_t* cellSet;
+
+  for (k = 0; k < NUM_CELL_LINES; k++) {
+    missing = lineValues & ~masks[k][cellIndex];
+    lineValues &= masks[k][cellIndex];
+
+    valueCells = &(cells->valueCells[cells->constraintIndexes[k][cellIndex] *
+                                     (MAX_PROBLEM_SIZE + 1)]);
+    for (; missing; missing &= missing - 1)
+      ADD_TO_CELL_SET(reasons, valueCells[LOWEST_VALUE(missing)]);
+  }
+
+  if (lineValues & ~masks[BLOCK_CONSTRAINT_INDEX][cellIndex]) {
+    cellSet = &(solver->constraintCells[
+        cells->constraintIndexes[BLOCK_CONSTRAINT_INDEX][cellIndex]]);
+    for (i = 0; i < CELL_SET_WORDS; i++)
+      reasons->words[i] |= cellSet->words[i];
+  }
+
+  if (lineValues & masks[BLOCK_CONSTRAINT_INDEX][cellIndex] &
+      ~masks[DEDUCTION_MASK_INDEX][cellIndex]) {
+    cellSet = &(cells->deductionCells[cellIndex]);
+    for (i = 0; i < CELL_SET_WORDS; i++)
+      reasons->words[i] |= cellSet->words[i];
+  }
+}
+
+// Add to conflict the assigned cells whose values removed possibles from an
+// unassigned cell
+inline void explainCell(kenken_solver_t* solver, int cellIndex,
+                        cellset_t* conflict) {
+  int i;
+  cellset_t reasons;
+
+  CLEAR_CELL_SET(&reasons);
+  addCellReasons(solver, cellIndex, &reasons);
+
+  for (i = 0; i < CELL_SET_WORDS; i++)
+    conflict->words[i] |= reasons.words[i] &
+                          solver->cells->assignedCells->words[i];
+}
+
+// Set conflict to the assigned cells whose values removed possibles from a
+// line constraint's cells, which explains any deduction or failure in the line
+inline void explainLine(kenken_solver_t* solver, constraint_t* constraint,
+                        cellset_t* conflict) {
+  cells_t* cells = solver->cells;
+  int i;
+  int* listCells = &(cells->listCells[constraint->cellList.offset]);
+  cellset_t reasons = solver->constraintCells[constraint->index];
+
+  for (i = 0; i < constraint->cellList.size; i++)
+    addCellReasons(solver, listCells[i], &reasons);
+
+  for (i = 0; i < CELL_SET_WORDS; i++)
+    conflict->words[i] = reasons.words[i] & cells->assignedCells->words[i];
+}
+
+// Add the cells explaining the deductions in the line being propagated to a
+// cell's deduction cells, recording the old cells in the trail
+inline void addDeductionCells(kenken_solver_t* solver, int cellIndex) {
+  int i;
+  unsigned long long* words = solver->cells->deductionCells[cellIndex].words;
+
+  if (!solver->lineExplained) {
+    explainLine(solver, solver->propagatingLine, &(solver->lineConflict));
+    solver->lineExplained = 1;
+  }
+
+  for (i = 0; i < CELL_SET_WORDS; i++) {
+    if (!(solver->lineConflict.words[i] & ~words[i]))
+      continue;
+
+    if (solver->trail)
+      recordChange(solver, TRAIL_DEDUCTION_CELLS, cellIndex, i,
+                   (long)words[i]);
+    words[i] |= solver->lineConflict.words[i];
+  }
+}
+
+// Learn a conflict as a nogood, unless it has too many cells or is above a
+// solution (so includes cell indexes past the last cell), forgetting an old
+// nogood if the solver's nogoods are full. The nogood watches its last
+// assigned cell's value, which is the first to be unassigned.
+void learnNogood(kenken_solver_t* solver, cellset_t* conflict) {
+  nogoods_t* nogoods = solver->nogoods;
+  cells_t* cells = solver->cells;
+  int i, j, slot, numCells = 0;
+  int cellIndexes[MAX_NOGOOD_CELLS];
+  unsigned long long word;
+  nogood_t* nogood;
+
+  for (j = 0; j < CELL_SET_WORDS; j++) {
+    for (word = conflict->words[j]; word; word &= word - 1) {
+      i = 64 * j + __builtin_ctzll(word);
+      if (numCells == MAX_NOGOOD_CELLS || i >= solver->totalNumCells)
+        return;
+      cellIndexes[numCells++] = i;
+    }
+  }
+
+  // An empty conflict means the puzzle has no solution, so the search is over
+  if (numCells == 0)
+    return;
+
+  // Take the next free nogood, or forget the first nogood under the clock hand
+  // not used since the hand last passed it
+  if (nogoods->size < MAX_NOGOODS)
+    slot = nogoods->size++;
+  else {
+    while (nogoods->nogoods[nogoods->hand].used) {
+      nogoods->nogoods[nogoods->hand].used = 0;
+      nogoods->hand = (nogoods->hand + 1) % MAX_NOGOODS;
+    }
+
+    slot = nogoods->hand;
+    nogoods->hand = (nogoods->hand + 1) % MAX_NOGOODS;
+    unwatchNogood(nogoods, slot);
+  }
+
+  nogood = &(nogoods->nogoods[slot]);
+  nogood->numCells = numCells;
+  nogood->used = 0;
+  nogood->watch = 0;
+
+  for (i = 0; i < numCells; i++) {
+    nogood->cellIndexes[i] = cellIndexes[i];
+    nogood->values[i] = cells->values[cellIndexes[i]];
+
+    if (cells->assignTimes[cellIndexes[i]] >
+        cells->assignTimes[cellIndexes[nogood->watch]])
+      nogood->watch = i;
+  }
+
+  watchNogood(nogoods, slot);
+}
+
+// Add a nogood to the front of the list of its watched cell value
+inline void watchNogood(nogoods_t* nogoods, int slot) {
+  int list = WATCH_LIST(&(nogoods->nogoods[slot]));
+
+  nogoods->prev[slot] = -1;
+  nogoods->next[slot] = nogoods->heads[list];
+  if (nogoods->heads[list] >= 0)
+    nogoods->prev[nogoods->heads[list]] = slot;
+  nogoods->heads[list] = slot;
+}
+
+// Remove a nogood from the list of its watched cell value
+inline void unwatchNogood(nogoods_t* nogoods, int slot) {
+  if (nogoods->prev[slot] >= 0)
+    nogoods->next[nogoods->prev[slot]] = nogoods->next[slot];
+  else
+    nogoods->heads[WATCH_LIST(&(nogoods->nogoods[slot]))] =
+        nogoods->next[slot];
+
+  if (nogoods->next[slot] >= 0)
+    nogoods->prev[nogoods->next[slot]] = nogoods->prev[slot];
+}
+
+// Allocate an empty set of nogoods
+nogoods_t* allocateNogoods() {
+  nogoods_t* nogoods = (nogoods_t*)malloc(sizeof(nogoods_t));
+  if (!nogoods)
+    unixError("Failed to allocate memory for the nogoods");
+
+  emptyNogoods(nogoods);
+  return nogoods;
+}
+
+// Forget every nogood in a set of nogoods
+void emptyNogoods(nogoods_t* nogoods) {
+  nogoods->size = 0;
+  nogoods->hand = 0;
+  memset(nogoods->heads, 0xff, sizeof(nogoods->heads));
+}
+
+// Forget the nogoods a solver learned
+void clearNogoods(kenken_solver_t* solver) {
+  if (solver->nogoods)
+    emptyNogoods(solver->nogoods);
+}
+
+// Check whether the solver's state was already searched without finding a
+// solution, making the assigned cells the failure's cause if so
+int isFailedState(kenken_solver_t* solver) {
+  failedstates_t* failedStates = solver->failedStates;
+  unsigned long long hash = solver->stateHash;
+  unsigned long long* bucket;
+  int i;
+
+  // A hash of 0 can not be told apart from an empty entry
+  if (!failedStates || hash == 0)
+    return 0;
+
+  bucket = FAILED_STATE_BUCKET(failedStates, hash);
+  for (i = 0; i < FAILED_STATE_BUCKET_SIZE; i++) {
+    if (__atomic_load_n(&(bucket[i]), __ATOMIC_RELAXED) == hash) {
+      solver->cacheHits++;
+      if (solver->stats)
+        solver->stats->cachedFailures++;
+      if (solver->useBackjumping)
+        solver->failure = *(solver->cells->assignedCells);
+      return 1;
+    }
+  }
+
+  solver->cacheMisses++;
+  return 0;
+}
+
+// Add the solver's state to the failed-state cache, in an empty entry of its
+// bucket if there is one
+void addFailedState(kenken_solver_t* solver) {
+  failedstates_t* failedStates = solver->failedStates;
+  unsigned long long hash = solver->stateHash;
+  unsigned long long* bucket;
+  unsigned long long entry;
+  int i;
+
+  if (!failedStates || hash == 0)
+    return;
+
+  bucket = FAILED_STATE_BUCKET(failedStates, hash);
+  for (i = 0; i < FAILED_STATE_BUCKET_SIZE; i++) {
+    entry = __atomic_load_n(&(bucket[i]), __ATOMIC_RELAXED);
+    if (entry == hash)
+      return;
+    if (entry == 0)
+      break;
+  }
+
+  if (i == FAILED_STATE_BUCKET_SIZE)
+    i = (hash >> 32) % FAILED_STATE_BUCKET_SIZE;
+  __atomic_store_n(&(bucket[i]), hash, __ATOMIC_RELAXED);
+}
+
+// Update the state hash for a cell's value changing from oldValue to newValue
+// (either can be UNASSIGNED_VALUE)
+inline void updateStateHash(kenken_solver_t* solver, int cellIndex,
+                            int oldValue, int newValue) {
+  cells_t* cells = solver->cells;
+  int row = cells->constraintIndexes[ROW_CONSTRAINT_INDEX][cellIndex];
+  int column = cells->constraintIndexes[COLUMN_CONSTRAINT_INDEX][cellIndex];
+  constraint_t* cage = &(solver->constraints[
+      cells->constraintIndexes[BLOCK_CONSTRAINT_INDEX][cellIndex]]);
+
+  // A cage's assigned values are only hashed while it has unassigned cells,
+  // since a full cage does not constrain the cells left
+  if (cage->numUnassigned > 0)
+    solver->stateHash ^= cage->assignedHash;
+
+  if (oldValue != UNASSIGNED_VALUE) {
+    solver->stateHash ^= CELL_KEY(solver, cellIndex) ^
+                         LINE_KEY(solver, row, oldValue) ^
+                         LINE_KEY(solver, column, oldValue);
+    cage->assignedHash ^= VALUE_KEY(solver, cellIndex, oldValue);
+    cage->numUnassigned++;
+  }
+
+  if (newValue != UNASSIGNED_VALUE) {
+    solver->stateHash ^= CELL_KEY(solver, cellIndex) ^
+                         LINE_KEY(solver, row, newValue) ^
+                         LINE_KEY(solver, column, newValue);
+    cage->assignedHash ^= VALUE_KEY(solver, cellIndex, newValue);
+    cage->numUnassigned--;
+  }
+
+  if (cage->numUnassigned > 0)
+    solver->stateHash ^= cage->assignedHash;
+
+  // The state is looked up after propagating it, so fetch its bucket meanwhile
+  __builtin_prefetch(FAILED_STATE_BUCKET(solver->failedStates,
+                                         solver->stateHash));
+}
+
+// Get the next random key of a SplitMix64 sequence
+inline unsigned long long nextStateKey(unsigned long long* seed) {
+  unsigned long long key = (*seed += 0x9e3779b97f4a7c15ULL);
+  key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+  return key ^ (key >> 31);
+}
+
+// Allocate an empty failed-state cache of cacheSize megabytes, and the keys
+// hashed into the state, for a solver with no cells assigned yet
+void allocateFailedStates(kenken_solver_t* solver, int cacheSize) {
+  failedstates_t* failedStates;
+  unsigned long long seed = 0;
+  unsigned long long numBuckets = 1;
+  size_t size = (size_t)cacheSize << 20;
+  int i;
+
+  solver->stateKeys = (unsigned long long*)malloc(
+      sizeof(unsigned long long) * NUM_STATE_KEYS(solver));
+  failedStates = (failedstates_t*)malloc(sizeof(failedstates_t));
+  if (!solver->stateKeys || !failedStates)
+    unixError("Failed to allocate memory for the failed-state cache");
+
+  // Every solver of a puzzle hashes its states with the same keys
+  for (i = 0; i < NUM_STATE_KEYS(solver); i++)
+    solver->stateKeys[i] = nextStateKey(&seed);
+
+  for (i = 0; i < solver->numConstraints; i++) {
+    solver->constraints[i].assignedHash = 0;
+    solver->constraints[i].numUnassigned = solver->constraints[i].cellList.size;
+  }
+  solver->stateHash = 0;
+
+  // Largest power of 2 buckets that fit, mapped so the entries start empty and
+  // memory is only used once touched
+  while (2 * numBuckets * FAILED_STATE_BUCKET_BYTES <= size)
+    numBuckets *= 2;
+  failedStates->numBuckets = numBuckets;
+  failedStates->entries = (unsigned long long*)mmap(
+      NULL, numBuckets * FAILED_STATE_BUCKET_BYTES, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (failedStates->entries == MAP_FAILED)
+    unixError("Failed to allocate memory for the failed-state cache");
+
+  solver->failedStates = failedStates;
+}
+
+// Free a failed-state cache
+void freeFailedStates(failedstates_t* failedStates) {
+  munmap(failedStates->entries,
+         failedStates->numBuckets * FAILED_STATE_BUCKET_BYTES);
+  free(failedStates);
+}
+
+// Initialize a search of a solver's nodes, with no node limit, no hooks and
+// no path recorded
+void initSearch(search_t* search, kenken_solver_t* solver, trail_t* trail,
+                solvemode_t mode, writer_t* writer, long long* nodeCount,
+                long long* numSolutions) {
+  search->solver = solver;
+  search->trail = trail;
+  search->mode = mode;
+  search->writer = writer;
+  search->nodeCount = nodeCount;
+  search->numSolutions = numSolutions;
+  search->nodeLimit = LLONG_MAX;
+  search->stopNode = NULL;
+  search->countSolution = NULL;
+  search->data = NULL;
+  search->path = NULL;
+  search->pathPossibles = NULL;
+}
+
+// Main recursive function used to search a solver's nodes. Deductions made by
+// propagation are recorded in the search's trail. Returns whether the search
+// should stop. When backjumping, conflict is set to the cells whose values
+// caused the search to fail.
+int searchNode(search_t* search, int step, cellset_t* conflict) {
+  kenken_solver_t* solver = search->solver;
+  int cellIndex;
+  int value = UNASSIGNED_VALUE;
+  int mark = search->trail->size;
+  long long solutionCount = *(search->numSolutions);
+  cellset_t childConflict;
+
+  if (*(search->nodeCount) >= search->nodeLimit ||
+      (search->stopNode && search->stopNode(search, step)))
+    return 1;
+
+  // Found solution if all cells filled in
+  if (step == solver->totalNumCells) {
+    solutionCount = ++*(search->numSolutions);
+    if (search->countSolution)
+      solutionCount = search->countSolution(search);
+
+    if (WRITE_SOLUTION(search->mode, solutionCount))
+      writeSolution(search->writer, solver, search->mode);
+
+    // Nodes above a solution are neither jumped over nor learned
+    FILL_CELL_SET(conflict);
+    return STOP_SEARCH(search->mode, solutionCount);
+  }
+
+  (*(search->nodeCount))++;
+  // Make deductions, then unless the state already failed, find the next cell
+  // to fill and test all possible values, unless a value fails without the
+  // cell's value causing it. The deductions are undone before returning.
+  if (!propagate(solver, search->trail) || isFailedState(solver) ||
+      (cellIndex = getNextCellToFill(solver)) == IMPOSSIBLE_STATE)
+    explainFailure(solver, conflict);
+  else {
+    CLEAR_CELL_SET(conflict);
+    if (search->path) {
+      search->path[step].cellIndex = cellIndex;
+      search->pathPossibles[step] = getPossibles(solver, cellIndex);
+    }
+    while (UNASSIGNED_VALUE != (value = applyNextValue(solver, cellIndex,
+                                                       value))) {
+      if (search->path)
+        search->path[step].value = value;
+      if (!checkNogoods(solver, cellIndex, &childConflict) &&
+          searchNode(search, step + 1, &childConflict))
+        return 1;
+
+      if (backjump(solver, cellIndex, value, &childConflict, conflict))
+        break;
+    }
+
+    if (value == UNASSIGNED_VALUE)
+      learnConflict(solver, cellIndex, conflict);
+
+    // The state has no solution if searching it found none
+    if (*(search->numSolutions) == solutionCount)
+      addFailedState(solver);
+  }
+
+  undoTrail(solver, search->trail, mark);
+  return 0;
+}
+
+// Copy a job into dest. Returns 0 if the job's length is invalid, which can
+// only happen if another thread is overwriting the job.
+int copyJob(job_t* dest, job_t* job) {
+  int length = job->length;
+
+  if (length < 0 || length > MAX_PROBLEM_SIZE * MAX_PROBLEM_SIZE)
+    return 0;
+
+  dest->length = length;
+  memcpy(dest->assignments, job->assignments, sizeof(assignment_t) * length);
+  return 1;
+}
+
+// Load a job into mySolver, starting from solver's state
+void loadJob(kenken_solver_t* mySolver, kenken_solver_t* solver,
+             trail_t* trail, job_t* job) {
+  int i;
+
+  copySolver(mySolver, solver);
+  trail->size = 0;
+  for (i = 0; i < job->length; i++)
+    applyValue(mySolver, job->assignments[i].cellIndex,
+               job->assignments[i].value);
+
+  // The job's cells were changed without being propagated
+  queueAllLines(mySolver);
+}
+
+// Split the search into at least numTarget jobs in the serial search order,
+// splitting the jobs of each level in order until there are enough. Jobs left
+// once there are enough are kept whole, as are solutions.
+job_t* splitJobs(kenken_solver_t* solver, kenken_solver_t* mySolver,
+                 trail_t* trail, long numTarget, long* numJobsPtr,
+                 long long* nodeCount) {
+  long i, numJobs, numParents, capacity = MAX(numTarget, 1);
+  int cellIndex, split;
+  int value = UNASSIGNED_VALUE;
+  job_t* jobs, *parents, *child;
+
+  jobs = (job_t*)malloc(sizeof(job_t) * capacity);
+  if (!jobs)
+    unixError("Failed to allocate memory for the jobs");
+  jobs[0].length = 0;
+  numJobs = 1;
+
+  do {
+    parents = jobs;
+    numParents = numJobs;
+    jobs = (job_t*)malloc(sizeof(job_t) * capacity);
+    if (!jobs)
+      unixError("Failed to allocate memory for the jobs");
+    numJobs = 0;
+    split = 0;
+
+    for (i = 0; i < numParents; i++) {
+      if (numJobs + numParents - i >= numTarget ||
+          parents[i].length == solver->totalNumCells) {
+        appendJob(&jobs, &numJobs, &capacity, &(parents[i]));
+        continue;
+      }
+
+      loadJob(mySolver, solver, trail, &(parents[i]));
+      (*nodeCount)++;
+      if (!propagate(mySolver, trail) ||
+          (cellIndex = getNextCellToFill(mySolver)) == IMPOSSIBLE_STATE)
+        continue;
+
+      split = 1;
+      while (UNASSIGNED_VALUE != (value = applyNextValue(mySolver, cellIndex,
+                                                         value))) {
+        child = appendJob(&jobs, &numJobs, &capacity, &(parents[i]));
+        child->assignments[child->length].cellIndex = cellIndex;
+        child->assignments[child->length].value = value;
+        child->length++;
+      }
+    }
+
+    free(parents);
+  } while (split && numJobs < numTarget);
+
+  *numJobsPtr = numJobs;
+  return jobs;
+}
+
+// Append a copy of a job to an array of jobs, growing the array if full.
+// Returns the copy.
+job_t* appendJob(job_t** jobsPtr, long* numJobsPtr, long* capacityPtr,
+                 job_t* job) {
+  if (*numJobsPtr == *capacityPtr) {
+    *capacityPtr *= 2;
+    *jobsPtr = (job_t*)realloc(*jobsPtr, sizeof(job_t) * *capacityPtr);
+    if (!*jobsPtr)
+      unixError("Failed to grow the jobs");
+  }
+
+  copyJob(&((*jobsPtr)[*numJobsPtr]), job);
+  return &((*jobsPtr)[(*numJobsPtr)++]);
+}
+
+// Print solution to stdout
+void printSolution(kenken_solver_t* solver) {
+  cells_t* cells = solver->cells;
+  int i;
+  for (i = 0; i < solver->totalNumCells; i++)
+    printf("%d%c", cells->values[i], ((i + 1) % solver->N != 0) ? ' ' : '\n');
+}
+
+// Remove the solve mode option (if any) from the command line arguments and
+// return the mode, or -1 if an option is not recognized
+int getSolveMode(int* argcPtr, char** argv) {
+  int i, j;
+  int mode = FIRST_SOLUTION;
+
+  for (i = 1; i < *argcPtr; i++) {
+    if (strncmp(argv[i], "--", 2) != 0)
+      continue;
+
+    if (strcmp(argv[i], "--count") == 0)
+      mode = COUNT_SOLUTIONS;
+    else if (strcmp(argv[i], "--unique") == 0)
+      mode = UNIQUE_SOLUTION;
+    else if (strcmp(argv[i], "--all") == 0)
+      mode = ALL_SOLUTIONS;
+    else
+      return -1;
+
+    // Shift the remaining arguments over the option
+    for (j = i; j < *argcPtr - 1; j++)
+      argv[j] = argv[j + 1];
+    (*argcPtr)--;
+    i--;
+  }
+
+  return mode;
+}
+
+// Remove all occurrences of an option from the command line arguments, and
+// return whether it was given
+int removeOption(int* argcPtr, char** argv, char* option) {
+  int i, j, given = 0;
+
+  for (i = 1; i < *argcPtr; i++) {
+    if (strcmp(argv[i], option) != 0)
+      continue;
+
+    // Shift the remaining arguments over the option
+    for (j = i; j < *argcPtr - 1; j++)
+      argv[j] = argv[j + 1];
+    (*argcPtr)--;
+    i--;
+    given = 1;
+  }
+
+  return given;
+}
+
+// Remove an option and the value after it from the command line arguments,
+// and return the value (NULL if not given, empty if it has no value)
+char* removeOptionValue(int* argcPtr, char** argv, char* option) {
+  int i, j, numRemoved;
+  char* value;
+
+  for (i = 1; i < *argcPtr; i++) {
+    if (strcmp(argv[i], option) == 0)
+      break;
+  }
+
+  if (i == *argcPtr)
+    return NULL;
+
+  value = (i + 1 < *argcPtr) ? argv[i + 1] : "";
+  numRemoved = (i + 1 < *argcPtr) ? 2 : 1;
+
+  // Shift the remaining arguments over the option and its value
+  for (j = i; j < *argcPtr - numRemoved; j++)
+    argv[j] = argv[j + numRemoved];
+  *argcPtr -= numRemoved;
+
+  return value;
+}
+
+// Remove the search options (if any) from the command line arguments and
+// return them in options
+int getSearchOptions(int* argcPtr, char** argv, searchoptions_t* options) {
+  char* order = removeOptionValue(argcPtr, argv, "--order");
+  char* cache = removeOptionValue(argcPtr, argv, "--cache");
+
+  if (!order || strcmp(order, "mrv") == 0)
+    options->cellOrder = MIN_POSSIBLES_ORDER;
+  else if (strcmp(order, "cage") == 0)
+    options->cellOrder = CAGE_ORDER;
+  else if (strcmp(order, "domdeg") == 0)
+    options->cellOrder = DOM_DEG_ORDER;
+  else if (strcmp(order, "domwdeg") == 0)
+    options->cellOrder = DOM_WDEG_ORDER;
+  else
+    return 0;
+
+  options->useMatching = removeOption(argcPtr, argv, "--alldifferent");
+  options->useBackjumping = removeOption(argcPtr, argv, "--backjump");
+  options->cacheSize = cache ? atoi(cache) : 0;
+  if (cache && options->cacheSize <= 0)
+    return 0;
+
+  options->valueOrder = removeOption(argcPtr, argv, "--lcv") ?
+                        LEAST_CONSTRAINING_VALUE_ORDER :
+                        DESCENDING_VALUE_ORDER;
+  return 1;
+}
+
+// Use search options in a solver
+void setSearchOptions(kenken_solver_t* solver, searchoptions_t* options) {
+  if (options->useMatching)
+    solver->linePropagation = MATCHING_PROPAGATION;
+  solver->cellOrder = options->cellOrder;
+  solver->valueOrder = options->valueOrder;
+
+  solver->useBackjumping = options->useBackjumping;
+  if (solver->useBackjumping && !solver->nogoods)
+    solver->nogoods = allocateNogoods();
 
-    // Read in value
-    ptr = strtok(NULL, " ");
-    value = atol(ptr);
+  if (options->cacheSize > 0 && !solver->failedStates)
+    allocateFailedStates(solver, options->cacheSize);
+}
 
-    // Read in cell coordinates
-    initList(cellList);
-    while ((ptr = strtok(NULL, ", "))) {
-      x = atoi(ptr);
-      ptr = strtok(NULL, ", ");
-      y = atoi(ptr);
+// Allocate an empty writer to the given stream
+writer_t* allocateWriter(FILE* out) {
+  writer_t* writer = (writer_t*)malloc(sizeof(writer_t));
+  if (!writer)
+    unixError("Failed to allocate memory for the writer");
 
-      // Add block constraint to cell
-      addNode(cellList, GET_CELL(x, y));
-      cells[GET_CELL(x, y)].constraintIndexes[BLOCK_CONSTRAINT_INDEX] = i;
-    }
+  writer->out = out;
+  writer->size = 0;
+  return writer;
+}
 
-    constraint->value = value;
+// Flush and free a writer
+void freeWriter(writer_t* writer) {
+  flushWriter(writer);
+  free(writer);
+}
 
-    // Initialize constraint's type and possibles
-    switch (type) {
-      case '+':
-        constraint->type = PLUS;
-        initPlusCells(cells, cellList, value, constraint->cellList.size);
-        break;
-      case '-':
-        constraint->type = MINUS;
-        initMinusCells(cells, cellList, value);
-        break;
-      case 'x':
-        constraint->type = MULTIPLY;
-        initMultiplyCells(cells, cellList, value, constraint->cellList.size);
-        break;
-      case '/':
-        constraint->type = DIVIDE;
-        initDivideCells(cells, cellList, value);
-        break;
-      case '!':
-        constraint->type = SINGLE;
-        initSingleCells(cells, cellList, value);
-        break;
-      default:
-        appError("Malformed constraint in input file");
-    }
+// Write solution to writer, separating solutions with a blank line when
+// writing all solutions
+void writeSolution(writer_t* writer, kenken_solver_t* solver,
+                   solvemode_t mode) {
+  cells_t* cells = solver->cells;
+  int i;
+  char* ptr;
+
+  // Each value takes at most 3 bytes, plus a byte for the blank line
+  if (writer->size + 3 * solver->totalNumCells + 1 > WRITER_BUFFER_SIZE)
+    flushWriter(writer);
+
+  ptr = &(writer->buffer[writer->size]);
+  for (i = 0; i < solver->totalNumCells; i++) {
+    if (cells->values[i] >= 10)
+      *(ptr++) = '0' + cells->values[i] / 10;
+    *(ptr++) = '0' + cells->values[i] % 10;
+    *(ptr++) = ((i + 1) % solver->N != 0) ? ' ' : '\n';
   }
 
-  // Close file
-  fclose(in);
+  if (mode == ALL_SOLUTIONS)
+    *(ptr++) = '\n';
 
-  *constraintsPtr = constraints;
-  *cellsPtr = cells;
+  writer->size = ptr - writer->buffer;
 }
 
-// Get number of possibles for a specific cell
-inline int getNumPossibles(cell_t* cells, int cellIndex) {
-  return cells[cellIndex].numPossibles;
+// Write everything buffered in writer to its stream
+void flushWriter(writer_t* writer) {
+  if (writer->size == 0)
+    return;
+
+  if (fwrite(writer->buffer, 1, writer->size, writer->out) != writer->size)
+    unixError("Failed to write solutions");
+  fflush(writer->out);
+  writer->size = 0;
 }
 
-// Apply a value to a specific cell, updating its constraints
-inline void applyValue(cell_t* cells, constraint_t* constraints, int cellIndex,
-                       int value) {
-  int i;
-  cell_t* cell = &(cells[cellIndex]);
-  constraint_t* constraint;
+// Print the number of solutions found to out, unless only searching for the
+// first
+void printSolutionCount(FILE* out, solvemode_t mode, long long numSolutions) {
+  if (mode == FIRST_SOLUTION)
+    return;
 
-  // Remove cell from its constraints, and update constraint
-  for (i = 0; i < NUM_CELL_CONSTRAINTS; i++) {
-    constraint = &(constraints[cell->constraintIndexes[i]]);
-    removeNode(&(constraint->cellList), cellIndex);
-    updateConstraint(cells, constraint, UNASSIGNED_VALUE, value);
-  }
+  // Parallel searches can find more solutions before they all stop
+  if (mode == UNIQUE_SOLUTION && numSolutions > 2)
+    numSolutions = 2;
 
-  cell->value = value;
+  fprintf(out, "Solutions: %lld\n", numSolutions);
+  if (mode == UNIQUE_SOLUTION)
+    fprintf(out, "Unique: %s\n", (numSolutions == 1) ? "yes" : "no");
 }
 
-// Get the next cell to fill in, remove it from its constraints, and return its
-// index
-inline int getNextCellToFill(cell_t* cells, constraint_t* constraints) {
-  return getNextCellToFillN(cells, constraints, INT_MAX);
+// Print the number of failed-state cache hits and misses to out, if the
+// search options cache failed states
+void printCacheCounts(FILE* out, searchoptions_t* options, long long hits,
+                      long long misses) {
+  if (options->cacheSize > 0)
+    fprintf(out, "Cache Hits: %lld\nCache Misses: %lld\n", hits, misses);
 }
 
-// Same as getNextCellToFill, except it imposes a max number of possibles
-// allowed for the chosen cell, returning TOO_MANY_POSSIBLES if broken.
-inline int getNextCellToFillN(cell_t* cells, constraint_t* constraints,
-                              int maxPossibles) {
-  int i, numPossibles;
-  int minIndex = -1, minPossibles = INT_MAX;
-  cell_t* cell;
-  constraint_t* constraint;
+// Open the calling thread's performance counters, disabled. Returns the number
+// of counters opened.
+int openPerfCounters(perfcounters_t* counters) {
+  int i, numOpened = 0;
+#ifdef PERF_COUNTERS
+  struct perf_event_attr attr;
+#endif
+
+  for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+    counters->fds[i] = -1;
+    counters->counts[i] = -1;
+
+#ifdef PERF_COUNTERS
+    // Count only this thread's user time, which unprivileged users can
+    memset(&attr, 0, sizeof(struct perf_event_attr));
+    attr.size = sizeof(struct perf_event_attr);
+    attr.type = perfCounterTypes[i];
+    attr.config = perfCounterConfigs[i];
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    counters->fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (counters->fds[i] >= 0)
+      numOpened++;
+#endif
+  }
 
-  // Find the unassigned cell with the mininum number of possibilities
-  for (i = 0; i < totalNumCells; i++) {
-    cell = &(cells[i]);
+  return numOpened;
+}
 
-    // Skip assigned cells
-    if (cell->value != UNASSIGNED_VALUE)
+// Reset and enable a thread's open performance counters. Only the thread that
+// opened them is counted.
+void startPerfCounters(perfcounters_t* counters) {
+#ifdef PERF_COUNTERS
+  int i;
+
+  for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+    if (counters->fds[i] < 0)
       continue;
 
-    numPossibles = cell->numPossibles;
+    ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+    ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+#endif
+}
 
-    // Fail early if found unassigned cell with no possibilities
-    if (numPossibles == 0)
-      return IMPOSSIBLE_STATE;
+// Disable a thread's performance counters and read their counts
+void stopPerfCounters(perfcounters_t* counters) {
+#ifdef PERF_COUNTERS
+  int i;
+  // Count, then the times the counter was enabled and actually counting
+  unsigned long long values[3];
 
-    if (numPossibles < minPossibles) {
-      minIndex = i;
-      minPossibles = numPossibles;
-    }
+  for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+    if (counters->fds[i] >= 0)
+      ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
   }
 
-  if (minPossibles > maxPossibles)
-    return TOO_MANY_POSSIBLES;
+  for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+    counters->counts[i] = -1;
+    if (counters->fds[i] < 0 ||
+        read(counters->fds[i], values, sizeof(values)) != sizeof(values))
+      continue;
 
-  // Remove cell from its constraints in preparation for updating
-  cell = &(cells[minIndex]);
-  for (i = 0; i < NUM_CELL_CONSTRAINTS; i++) {
-    constraint = &(constraints[cell->constraintIndexes[i]]);
-    removeNode(&(constraint->cellList), minIndex);
+    // Scale up counts of counters that shared the hardware with others
+    if (values[2] == 0)
+      counters->counts[i] = 0;
+    else if (values[2] < values[1])
+      counters->counts[i] = (long long)((double)values[0] * values[1] /
+                                        values[2]);
+    else
+      counters->counts[i] = values[0];
   }
-
-  return minIndex;
+#endif
 }
 
-// Apply and return next value for the cell currently filling in
-inline int applyNextValue(cell_t* cells, constraint_t* constraints,
-                          int cellIndex, int previousValue) {
+// Close a thread's performance counters, keeping their counts
+void closePerfCounters(perfcounters_t* counters) {
   int i;
-  int value = (previousValue != UNASSIGNED_VALUE) ? previousValue - 1 : N;
-  cell_t* cell = &(cells[cellIndex]);
-  constraint_t* constraint;
 
-  for (; value > 0; value--) {
-    if (cell->possibles[value] != NUM_CELL_CONSTRAINTS)
-      continue;
-
-    cell->value = value;
+  for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+    if (counters->fds[i] >= 0)
+      close(counters->fds[i]);
+    counters->fds[i] = -1;
+  }
+}
 
-    for (i = 0; i < NUM_CELL_CONSTRAINTS; i++) {
-      constraint = &(constraints[cell->constraintIndexes[i]]);
-      updateConstraint(cells, constraint, previousValue, value);
-    }
+// Add the counts of src to dest. A count is -1 if either count is -1.
+void addPerfCounters(perfcounters_t* dest, perfcounters_t* src) {
+  int i;
 
-    return value;
+  for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+    if (dest->counts[i] < 0 || src->counts[i] < 0)
+      dest->counts[i] = -1;
+    else
+      dest->counts[i] += src->counts[i];
   }
+}
 
-  for (i = 0; i < NUM_CELL_CONSTRAINTS; i++) {
-    constraint = &(constraints[cell->constraintIndexes[i]]);
-    updateConstraint(cells, constraint, previousValue, UNASSIGNED_VALUE);
+// Print the counts of performance counters to out, and their counts per node
+// visited
+void printPerfCounters(FILE* out, perfcounters_t* counters,
+                       long long nodeCount) {
+  int i;
 
-    // Add cell back to cell list after updating constraint so cell's
-    // possibles are not changed during the update
-    addNode(&(constraint->cellList), cellIndex);
+  for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+    if (counters->counts[i] < 0)
+      fprintf(out, "%20s = not available\n", perfCounterNames[i]);
+    else if (nodeCount > 0)
+      fprintf(out, "%20s = %lld (%.1f per node)\n", perfCounterNames[i],
+              counters->counts[i], (double)counters->counts[i] / nodeCount);
+    else
+      fprintf(out, "%20s = %lld\n", perfCounterNames[i], counters->counts[i]);
   }
+}
 
-  cell->value = UNASSIGNED_VALUE;
-  return UNASSIGNED_VALUE;
+// Add the counters of src to dest
+void addSolverStats(solverstats_t* dest, solverstats_t* src) {
+  int i;
+
+  dest->cageViolations += src->cageViolations;
+  dest->emptyDomains += src->emptyDomains;
+  dest->lineFailures += src->lineFailures;
+  dest->nogoodFailures += src->nogoodFailures;
+  dest->cachedFailures += src->cachedFailures;
+  for (i = 0; i < NUM_CONSTRAINT_TYPES; i++)
+    dest->updates[i] += src->updates[i];
+  dest->linePropagations += src->linePropagations;
 }
 
-// Print solution to stdout
-void printSolution(cell_t* cells) {
+// Write a solver's counters to out as the last members of a JSON object, with
+// each line starting with indent
+void writeSolverStats(FILE* out, solverstats_t* stats, const char* indent) {
   int i;
-  for (i = 0; i < totalNumCells; i++)
-    printf("%d%c", cells[i].value, ((i + 1) % N != 0) ? ' ' : '\n');
+
+  fprintf(out, "%s\"failures\": {\"cageViolation\": %lld, "
+          "\"emptyDomain\": %lld, \"line\": %lld, \"nogood\": %lld, "
+          "\"cached\": %lld},\n", indent, stats->cageViolations,
+          stats->emptyDomains, stats->lineFailures, stats->nogoodFailures,
+          stats->cachedFailures);
+
+  fprintf(out, "%s\"updates\": {", indent);
+  for (i = 0; i < NUM_CONSTRAINT_TYPES; i++)
+    fprintf(out, "%s\"%s\": %lld", (i > 0) ? ", " : "", constraintTypeNames[i],
+            stats->updates[i]);
+  fprintf(out, "},\n");
+
+  fprintf(out, "%s\"linePropagations\": %lld\n", indent,
+          stats->linePropagations);
 }
 
 
 // Update constraint from having a cell with value oldCellValue to having the
 // cell assigned newCellValue (valid cell values include UNASSIGNED_VALUE).
-inline void updateConstraint(cell_t* cells, constraint_t* constraint,
-                             int oldCellValue, int newCellValue) {
-  celllist_t* cellList = &(constraint->cellList);
+inline void updateConstraint(kenken_solver_t* solver, constraint_t* constraint,
+                             int cellIndex, int oldCellValue,
+                             int newCellValue) {
   long value = constraint->value;
   long oldValue = value;
 
@@ -330,13 +1999,20 @@ inline void updateConstraint(cell_t* cells, constraint_t* constraint,
   if (newCellValue == UNASSIGNED_VALUE)
     newNumCells++;
 
+  if (solver->stats)
+    solver->stats->updates[constraint->type]++;
+
   switch (constraint->type) {
     case LINE:
       if (oldCellValue != UNASSIGNED_VALUE)
-        notifyCellsOfChange(cells, cellList, oldCellValue, 1);
-
-      if (newCellValue != UNASSIGNED_VALUE)
-        notifyCellsOfChange(cells, cellList, newCellValue, 0);
+        notifyCellsOfChange(solver, constraint, oldCellValue, 1);
+
+      if (newCellValue != UNASSIGNED_VALUE) {
+        notifyCellsOfChange(solver, constraint, newCellValue, 0);
+        solver->cells->valueCells[constraint->index *
+                                  (MAX_PROBLEM_SIZE + 1) + newCellValue] =
+            cellIndex;
+      }
       break;
 
     case PLUS:
@@ -345,8 +2021,11 @@ inline void updateConstraint(cell_t* cells, constraint_t* constraint,
       if (newCellValue != UNASSIGNED_VALUE)
         value -= newCellValue;
 
+      if (solver->trail)
+        recordChange(solver, TRAIL_CONSTRAINT_VALUE, constraint->index, 0,
+                     oldValue);
       constraint->value = value;
-      updatePlusCells(cells, cellList, oldValue, oldNumCells,
+      updatePlusCells(solver, constraint, oldValue, oldNumCells,
                       value, newNumCells);
       break;
 
@@ -354,14 +2033,14 @@ inline void updateConstraint(cell_t* cells, constraint_t* constraint,
       // Don't update possibles when num cells is 0 so undoing is easier
 
       if (oldNumCells == 2)
-        initMinusCellsHelper(cells, cellList, value, 0);
+        initMinusCellsHelper(solver, constraint, value, 0);
       else if (oldCellValue != UNASSIGNED_VALUE && oldNumCells == 1)
-        initPartialMinusCells(cells, cellList, value, oldCellValue, 0);
+        initPartialMinusCells(solver, constraint, value, oldCellValue, 0);
 
       if (newNumCells == 2)
-        initMinusCellsHelper(cells, cellList, value, 1);
+        initMinusCellsHelper(solver, constraint, value, 1);
       else if (newCellValue != UNASSIGNED_VALUE && newNumCells == 1)
-        initPartialMinusCells(cells, cellList, value, newCellValue, 1);
+        initPartialMinusCells(solver, constraint, value, newCellValue, 1);
 
       break;
 
@@ -371,8 +2050,11 @@ inline void updateConstraint(cell_t* cells, constraint_t* constraint,
       if (newCellValue != UNASSIGNED_VALUE)
         value /= newCellValue;
 
+      if (solver->trail)
+        recordChange(solver, TRAIL_CONSTRAINT_VALUE, constraint->index, 0,
+                     oldValue);
       constraint->value = value;
-      updateMultiplyCells(cells, cellList, oldValue, oldNumCells,
+      updateMultiplyCells(solver, constraint, oldValue, oldNumCells,
                           value, newNumCells);
       break;
 
@@ -380,271 +2062,925 @@ inline void updateConstraint(cell_t* cells, constraint_t* constraint,
       // Don't update possibles when num cells is 0 so undoing is easier
 
       if (oldNumCells == 2)
-        initDivideCellsHelper(cells, cellList, value, 0);
+        initDivideCellsHelper(solver, constraint, value, 0);
       else if (oldCellValue != UNASSIGNED_VALUE && oldNumCells == 1)
-        initPartialDivideCells(cells, cellList, value, oldCellValue, 0);
+        initPartialDivideCells(solver, constraint, value, oldCellValue, 0);
 
       if (newNumCells == 2)
-        initDivideCellsHelper(cells, cellList, value, 1);
+        initDivideCellsHelper(solver, constraint, value, 1);
       else if (newCellValue != UNASSIGNED_VALUE && newNumCells == 1)
-        initPartialDivideCells(cells, cellList, value, newCellValue, 1);
+        initPartialDivideCells(solver, constraint, value, newCellValue, 1);
       break;
 
     case SINGLE:
-      notifyCellsOfChange(cells, cellList, value, (char)(newNumCells == 1));
+      notifyCellsOfChange(solver, constraint, value, (char)(newNumCells == 1));
+      break;
+
+    case TABLE:
+      updateTableCells(solver, constraint, cellIndex, newCellValue);
       break;
   }
 }
 
 
 // Initializes a row constraint for the given row
-void initRowConstraint(cell_t* cells, constraint_t* constraints,
-                       int index, int row) {
-  int i;
+void initRowConstraint(kenken_solver_t* solver, int index, int row) {
+  cells_t* cells = solver->cells;
+  constraint_t* constraints = solver->constraints;
+  int i, N = solver->N;
   constraint_t* constraint = &(constraints[index]);
 
   constraint->type = LINE;
   constraint->value = -1;
+  constraint->index = index;
+  constraint->maskIndex = ROW_CONSTRAINT_INDEX;
 
   // Add constraint to its cells
-  initList(&(constraint->cellList));
+  initList(&(constraint->cellList), row * N);
   for (i = 0; i < N; i++) {
-    addNode(&(constraint->cellList), GET_CELL(row, i));
-    cells[GET_CELL(row, i)].constraintIndexes[ROW_CONSTRAINT_INDEX] = index;
+    addNode(solver, constraint, GET_CELL(row, i));
+    cells->constraintIndexes[ROW_CONSTRAINT_INDEX][GET_CELL(row, i)] = index;
   }
 
-  initLineCells(cells, &constraint->cellList);
+  initLineCells(solver, constraint);
 }
 
 // Initializes a column constraint for the given column
-void initColumnConstraint(cell_t* cells, constraint_t* constraints,
-                          int index, int col) {
-  int i;
+void initColumnConstraint(kenken_solver_t* solver, int index, int col) {
+  cells_t* cells = solver->cells;
+  constraint_t* constraints = solver->constraints;
+  int i, N = solver->N;
   constraint_t* constraint = &(constraints[index]);
 
   constraint->type = LINE;
   constraint->value = -1;
+  constraint->index = index;
+  constraint->maskIndex = COLUMN_CONSTRAINT_INDEX;
 
   // Add constraint to its cells
-  initList(&(constraint->cellList));
+  initList(&(constraint->cellList), solver->totalNumCells + col * N);
   for (i = 0; i < N; i++) {
-    addNode(&(constraint->cellList), GET_CELL(i, col));
-    cells[GET_CELL(i, col)].constraintIndexes[COLUMN_CONSTRAINT_INDEX] = index;
+    addNode(solver, constraint, GET_CELL(i, col));
+    cells->constraintIndexes[COLUMN_CONSTRAINT_INDEX][GET_CELL(i, col)] =
+        index;
   }
 
-  initLineCells(cells, &constraint->cellList);
+  initLineCells(solver, constraint);
 }
 
 
 // Initialize cell's possibles for a line constraint
-void initLineCells(cell_t* cells, celllist_t* cellList) {
-  notifyCellsOfChanges(cells, cellList, 1, N, 1);
+void initLineCells(kenken_solver_t* solver, constraint_t* constraint) {
+  notifyCellsOfChanges(solver, constraint, RANGE_MASK(1, solver->N), 1);
 }
 
 // Initialize cell's possibles for a plus constraint
-void initPlusCells(cell_t* cells, celllist_t* cellList, long value,
-                   int numCells) {
+void initPlusCells(kenken_solver_t* solver, constraint_t* constraint,
+                   long value, int numCells) {
   // Possibles = [start, end], everything else impossible
-  int start = MAX(1, value - N * (numCells - 1));
-  int end = MIN(N, value - (numCells - 1));
-  notifyCellsOfChanges(cells, cellList, start, end, 1);
+  int start = MAX(1, value - solver->N * (numCells - 1));
+  int end = MIN(solver->N, value - (numCells - 1));
+  notifyCellsOfChanges(solver, constraint, RANGE_MASK(start, end), 1);
 }
 
 // Initialize cell's possibles for a minus constraint
-void initMinusCells(cell_t* cells, celllist_t* cellList, long value) {
-  initMinusCellsHelper(cells, cellList, value, 1);
+void initMinusCells(kenken_solver_t* solver, constraint_t* constraint,
+                    long value) {
+  initMinusCellsHelper(solver, constraint, value, 1);
 }
 
 // Initialize cell's possibles for a multiply constraint
-void initMultiplyCells(cell_t* cells, celllist_t* cellList, long value,
-                       int numCells) {
-  int i;
+void initMultiplyCells(kenken_solver_t* solver, constraint_t* constraint,
+                       long value, int numCells) {
+  notifyCellsOfChanges(solver, constraint,
+                       getMultiplyMask(solver, value, numCells), 1);
+}
 
-  if (numCells == 0)
-    return;
+// Initialize cell's possibles for a divide constraint
+void initDivideCells(kenken_solver_t* solver, constraint_t* constraint,
+                     long value) {
+  initDivideCellsHelper(solver, constraint, value, 1);
+}
 
-  long maxLeft = maxMultiply[numCells - 1];
-  for (i = MAX(1, value / maxLeft); i <= MIN(value, N); i++) {
-    if (value % i == 0)
-      notifyCellsOfChange(cells, cellList, i, 1);
+// Initialize cell's possibles for a single constraint
+void initSingleCells(kenken_solver_t* solver, constraint_t* constraint,
+                     long value) {
+  notifyCellsOfChange(solver, constraint, value, 1);
+}
+
+// Initialize cell's possibles for a table constraint
+void initTableCells(kenken_solver_t* solver, constraint_t* constraint) {
+  updateTableCells(solver, constraint, -1, UNASSIGNED_VALUE);
+}
+
+
+// Create a table of the tuples of a plus or multiply cage, or return NULL if
+// the cage has too many cells or tuples for a table
+cagetable_t* createCageTable(kenken_solver_t* solver, constraint_t* constraint,
+                             type_t type, long value) {
+  cells_t* cells = solver->cells;
+  int i, j, k;
+  int capacity = INITIAL_TABLE_CAPACITY;
+  unsigned char values[MAX_TABLE_CELLS];
+  unsigned char* tuple;
+  domain_t* singleMasks;
+  cagetable_t* table;
+
+  if (constraint->cellList.size > MAX_TABLE_CELLS)
+    return NULL;
+
+  table = (cagetable_t*)calloc(sizeof(cagetable_t), 1);
+  if (!table)
+    unixError("Failed to allocate memory for a cage table");
+
+  table->numCells = constraint->cellList.size;
+  memcpy(table->cellIndexes, &(cells->listCells[constraint->cellList.offset]),
+         sizeof(int) * table->numCells);
+
+  table->tuples = (unsigned char*)malloc(capacity * table->numCells);
+  if (!table->tuples)
+    unixError("Failed to allocate memory for a cage table's tuples");
+
+  if (!addCageTuples(solver, table, type, value, 0, values, &capacity)) {
+    freeCageTable(table);
+    return NULL;
   }
+
+  // Index the tuples by their value at each position
+  table->numWords = table->numTuples / 64 + 1;
+  table->tupleSets = (unsigned long long*)calloc(
+      sizeof(unsigned long long),
+      table->numCells * (MAX_PROBLEM_SIZE + 1) * table->numWords);
+  table->singleMasks = (domain_t*)calloc(
+      sizeof(domain_t),
+      table->numCells * (MAX_PROBLEM_SIZE + 1) * table->numCells);
+  if (!table->tupleSets || !table->singleMasks)
+    unixError("Failed to allocate memory for a cage table's indexes");
+
+  for (i = 0; i < table->numTuples; i++) {
+    tuple = &(table->tuples[i * table->numCells]);
+    for (j = 0; j < table->numCells; j++) {
+      TUPLE_SET(table, j, tuple[j])[i / 64] |= 1ULL << (i % 64);
+      table->initialMasks[j] |= VALUE_MASK(tuple[j]);
+
+      singleMasks = SINGLE_MASKS(table, j, tuple[j]);
+      for (k = 0; k < table->numCells; k++)
+        singleMasks[k] |= VALUE_MASK(tuple[k]);
+    }
+  }
+
+  for (i = 0; i < table->numCells; i++)
+    solver->cagePositions[table->cellIndexes[i]] = i;
+
+  return table;
 }
 
-// Initialize cell's possibles for a divide constraint
-void initDivideCells(cell_t* cells, celllist_t* cellList, long value) {
-  initDivideCellsHelper(cells, cellList, value, 1);
+// Add the tuples of a cage's table that start with the given values before
+// position, and whose values from position onwards reach the remaining target.
+// Returns 0 if the cage has too many tuples for a table.
+int addCageTuples(kenken_solver_t* solver, cagetable_t* table, type_t type,
+                  long remaining, int position, unsigned char* values,
+                  int* capacityPtr) {
+  int i, value, N = solver->N;
+  int numCellsLeft = table->numCells - position - 1;
+  int cellIndex = table->cellIndexes[position];
+  long nextRemaining;
+
+  for (value = 1; value <= N; value++) {
+    // Skip values that leave a target the cells left can not reach
+    if (type == PLUS) {
+      nextRemaining = remaining - value;
+      if (nextRemaining < numCellsLeft ||
+          nextRemaining > (long)N * numCellsLeft)
+        continue;
+    }
+    else {
+      nextRemaining = remaining / value;
+      if (remaining % value != 0 ||
+          nextRemaining > solver->maxMultiply[numCellsLeft])
+        continue;
+    }
+
+    // Cells in the same row or column must have different values
+    for (i = 0; i < position; i++) {
+      if (values[i] == value &&
+          (table->cellIndexes[i] / N == cellIndex / N ||
+           table->cellIndexes[i] % N == cellIndex % N))
+        break;
+    }
+    if (i < position)
+      continue;
+
+    values[position] = value;
+    if (numCellsLeft > 0) {
+      if (!addCageTuples(solver, table, type, nextRemaining, position + 1,
+                         values, capacityPtr))
+        return 0;
+      continue;
+    }
+
+    // Add the complete tuple, growing the table if it is full
+    if (table->numTuples == MAX_TABLE_TUPLES)
+      return 0;
+
+    if (table->numTuples == *capacityPtr) {
+      *capacityPtr *= 2;
+      table->tuples = (unsigned char*)realloc(table->tuples, *capacityPtr *
+                                              table->numCells);
+      if (!table->tuples)
+        unixError("Failed to allocate memory for a cage table's tuples");
+    }
+
+    memcpy(&(table->tuples[table->numTuples * table->numCells]), values,
+           table->numCells);
+    table->numTuples++;
+  }
+
+  return 1;
 }
 
-// Initialize cell's possibles for a single constraint
-void initSingleCells(cell_t* cells, celllist_t* cellList, long value) {
-  notifyCellsOfChange(cells, cellList, value, 1);
+// Free a cage table
+void freeCageTable(cagetable_t* table) {
+  free(table->tuples);
+  free(table->tupleSets);
+  free(table->singleMasks);
+  free(table);
 }
 
 
 // Helper function for updating a plus constraint
-inline void updatePlusCells(cell_t* cells, celllist_t* cellList, long oldValue,
-                            int oldNumCells, long newValue, int newNumCells) {
+inline void updatePlusCells(kenken_solver_t* solver, constraint_t* constraint,
+                            long oldValue, int oldNumCells, long newValue,
+                            int newNumCells) {
   // Possibles = [start, end], everything else impossible
-  int oldStart = MAX(1, oldValue - N * (oldNumCells - 1));
-  int oldEnd = MIN(N, oldValue - (oldNumCells - 1));
+  int oldStart = MAX(1, oldValue - solver->N * (oldNumCells - 1));
+  int oldEnd = MIN(solver->N, oldValue - (oldNumCells - 1));
 
-  int newStart = MAX(1, newValue - N * (newNumCells - 1));
-  int newEnd = MIN(N, newValue - (newNumCells - 1));
+  int newStart = MAX(1, newValue - solver->N * (newNumCells - 1));
+  int newEnd = MIN(solver->N, newValue - (newNumCells - 1));
 
-  // Notify of new impossibles from start/end changes
-  notifyCellsOfChanges(cells, cellList, oldStart, newStart - 1, 0);
-  notifyCellsOfChanges(cells, cellList, newEnd + 1, oldEnd, 0);
+  domain_t oldMask = RANGE_MASK(oldStart, oldEnd);
+  domain_t newMask = RANGE_MASK(newStart, newEnd);
 
-  // Notify of new possibles from start/end changes
-  notifyCellsOfChanges(cells, cellList, newStart, oldStart - 1, 1);
-  notifyCellsOfChanges(cells, cellList, oldEnd + 1, newEnd, 1);
+  // Notify of new impossibles and new possibles from start/end changes
+  notifyCellsOfChanges(solver, constraint, oldMask & ~newMask, 0);
+  notifyCellsOfChanges(solver, constraint, newMask & ~oldMask, 1);
 }
 
 // Helper function for initializing/updating a minus constraint
-inline void initMinusCellsHelper(cell_t* cells, celllist_t* cellList,
-                                 long value, char markPossible) {
+inline void initMinusCellsHelper(kenken_solver_t* solver,
+                                 constraint_t* constraint, long value,
+                                 char markPossible) {
   // Impossibles = [N - value + 1, value], everything else possible
-  int secondStart = MAX(N - value + 1, value + 1);
-  notifyCellsOfChanges(cells, cellList, 1, N - value, markPossible);
-  notifyCellsOfChanges(cells, cellList, secondStart, N, markPossible);
+  int secondStart = MAX(solver->N - value + 1, value + 1);
+  notifyCellsOfChanges(solver, constraint, RANGE_MASK(1, solver->N - value) |
+                       RANGE_MASK(secondStart, solver->N), markPossible);
 }
 
 // Helper function for initializing/updating a partial minus constraint
-inline void initPartialMinusCells(cell_t* cells, celllist_t* cellList,
-                                 long value, int cellValue, char markPossible) {
-  if (cellValue + value <= N)
-    notifyCellsOfChange(cells, cellList, cellValue + value, markPossible);
+inline void initPartialMinusCells(kenken_solver_t* solver,
+                                  constraint_t* constraint, long value,
+                                  int cellValue, char markPossible) {
+  domain_t changes = 0;
+
+  if (cellValue + value <= solver->N)
+    changes |= VALUE_MASK(cellValue + value);
 
   if (cellValue - value > 0)
-    notifyCellsOfChange(cells, cellList, cellValue - value, markPossible);
+    changes |= VALUE_MASK(cellValue - value);
+
+  notifyCellsOfChanges(solver, constraint, changes, markPossible);
 }
 
 // Helper function for updating a multiply constraint
-inline void updateMultiplyCells(cell_t* cells, celllist_t* cellList,
-                                long oldValue, int oldNumCells, long newValue,
+inline void updateMultiplyCells(kenken_solver_t* solver,
+                                constraint_t* constraint, long oldValue,
+                                int oldNumCells, long newValue,
                                 int newNumCells) {
-  int i;
-  int oldStart = N + 1;
-  int newStart = N + 1;
-  int oldEnd = MIN(oldValue, N);
-  int newEnd = MIN(newValue, N);
-  char oldIsPossible, newIsPossible;
-
-  if (oldNumCells > 0)
-    oldStart = MAX(1, oldValue / maxMultiply[oldNumCells - 1]);
-  if (newNumCells > 0)
-    newStart = MAX(1, newValue / maxMultiply[newNumCells - 1]);
+  domain_t oldMask = getMultiplyMask(solver, oldValue, oldNumCells);
+  domain_t newMask = getMultiplyMask(solver, newValue, newNumCells);
 
-  for (i = MIN(oldStart, newStart); i <= MAX(oldEnd, newEnd); i++) {
-    oldIsPossible = (char)(i >= oldStart && i <= oldEnd && oldValue % i == 0);
-    newIsPossible = (char)(i >= newStart && i <= newEnd && newValue % i == 0);
-    if (oldIsPossible != newIsPossible)
-      notifyCellsOfChange(cells, cellList, i, newIsPossible);
-  }
+  notifyCellsOfChanges(solver, constraint, oldMask & ~newMask, 0);
+  notifyCellsOfChanges(solver, constraint, newMask & ~oldMask, 1);
 }
 
 // Helper function for initializing/updating a divide constraint
-inline void initDivideCellsHelper(cell_t* cells, celllist_t* cellList,
-                                  long value, char markPossible) {
+inline void initDivideCellsHelper(kenken_solver_t* solver,
+                                  constraint_t* constraint, long value,
+                                  char markPossible) {
   int i;
+  domain_t changes = 0;
 
   // Note that value can not equal 1 since 1,1 is the only answer to 1/
   // and a divide has either 2 cells on the same row or same column
-  for (i = 1; i <= N / value; i++) {
-    // Ensure don't double count a value
-    if (i % value != 0)
-      notifyCellsOfChange(cells, cellList, i, markPossible);
+  for (i = 1; i <= solver->N / value; i++)
+    changes |= VALUE_MASK(i) | VALUE_MASK(i * value);
 
-    notifyCellsOfChange(cells, cellList, i * value, markPossible);
-  }
+  notifyCellsOfChanges(solver, constraint, changes, markPossible);
 }
 
 // Helper function for initializing/updating a partial divide constraint
-inline void initPartialDivideCells(cell_t* cells, celllist_t* cellList,
-                                 long value, int cellValue, char markPossible) {
-  if (cellValue * value <= N)
-    notifyCellsOfChange(cells, cellList, cellValue * value, markPossible);
+inline void initPartialDivideCells(kenken_solver_t* solver,
+                                   constraint_t* constraint, long value,
+                                   int cellValue, char markPossible) {
+  domain_t changes = 0;
+
+  if (cellValue * value <= solver->N)
+    changes |= VALUE_MASK(cellValue * value);
 
   if ((cellValue % value == 0) && cellValue >= value)
-    notifyCellsOfChange(cells, cellList, cellValue / value, markPossible);
+    changes |= VALUE_MASK(cellValue / value);
+
+  notifyCellsOfChanges(solver, constraint, changes, markPossible);
 }
 
-// Notify cells that a possible value has changed state
-inline void notifyCellsOfChange(cell_t* cells, celllist_t* cellList, int value,
-                                char markPossible) {
+// Get mask of values that divide a multiply constraint's remaining value, and
+// are large enough given the number of cells left
+inline domain_t getMultiplyMask(kenken_solver_t* solver, long value,
+                                int numCells) {
   int i;
-  char flag;
+  domain_t mask = 0;
 
-  for (i = cellList->start; i != END_NODE; i = (cellList->cells[i]).next) {
-    flag = cells[i].possibles[value];
-    if (markPossible && flag == NUM_CELL_CONSTRAINTS - 1)
-      cells[i].numPossibles++;
-    if (!markPossible && flag == NUM_CELL_CONSTRAINTS)
-      cells[i].numPossibles--;
+  if (numCells == 0)
+    return 0;
 
-    cells[i].possibles[value] = (char)(flag + (markPossible ? 1 : -1));
+  for (i = MAX(1, value / solver->maxMultiply[numCells - 1]);
+       i <= MIN(value, solver->N); i++) {
+    if (value % i == 0)
+      mask |= VALUE_MASK(i);
   }
+
+  return mask;
+}
+
+// Notify cells that a possible value has changed state
+inline void notifyCellsOfChange(kenken_solver_t* solver,
+                                constraint_t* constraint, int value,
+                                char markPossible) {
+  notifyCellsOfChanges(solver, constraint, VALUE_MASK(value), markPossible);
 }
 
-// Notify cells that a range of possible values have changed state
-inline void notifyCellsOfChanges(cell_t* cells, celllist_t* cellList,
-                                 int start, int end, char markPossible) {
-  int i, j, flag, num;
+// Notify cells that a set of possible values have changed state
+inline void notifyCellsOfChanges(kenken_solver_t* solver,
+                                 constraint_t* constraint, domain_t changes,
+                                 char markPossible) {
+  cells_t* cells = solver->cells;
+  int i, k;
+  celllist_t* cellList = &(constraint->cellList);
+  int* listCells = &(cells->listCells[cellList->offset]);
+  domain_t** masks = cells->masks;
+  domain_t* constraintMasks = masks[constraint->maskIndex];
+
+  // Marking possible sets the changed bits, otherwise they are cleared
+  domain_t keep = markPossible ? (domain_t)~0 : (domain_t)~changes;
+  domain_t set = markPossible ? changes : 0;
+
+  if (!changes)
+    return;
 
-  if (end < start)
+#ifdef AVX2_KERNELS
+  if (solver->useAvx2 && constraint->maskIndex == ROW_CONSTRAINT_INDEX &&
+      !solver->trail) {
+    if (cellList->size > 0)
+      notifyRowOfChangesAvx2(solver, listCells[0] / solver->N, keep, set);
     return;
+  }
+#endif
+
+  for (k = 0; k < cellList->size; k++) {
+    i = listCells[k];
+    setCellMask(solver, i, constraint->maskIndex,
+                (constraintMasks[i] & keep) | set);
+  }
+}
+
+// Set the masks of the cells in a table constraint's cell list to their values
+// in the tuples that agree with the cage's assigned cells, where the cell at
+// cellIndex is being assigned newCellValue
+inline void updateTableCells(kenken_solver_t* solver,
+                             constraint_t* constraint, int cellIndex,
+                             int newCellValue) {
+  cells_t* cells = solver->cells;
+  cagetable_t* table = solver->cageTables[constraint->index];
+  int i, j, value, numAssigned = 0;
+  int assignedPosition = 0, assignedValue = 0;
+  unsigned long long word;
+  unsigned long long* assignedSets[MAX_TABLE_CELLS];
+  unsigned char* tuple;
+  domain_t supportedMasks[MAX_TABLE_CELLS];
+  domain_t* masks = table->initialMasks;
+  int* listCells = &(cells->listCells[constraint->cellList.offset]);
+
+  // Find the tuples with each assigned cell's value
+  for (i = 0; i < table->numCells; i++) {
+    value = (table->cellIndexes[i] == cellIndex) ? newCellValue :
+            cells->values[table->cellIndexes[i]];
+    if (value != UNASSIGNED_VALUE) {
+      assignedSets[numAssigned++] = TUPLE_SET(table, i, value);
+      assignedPosition = i;
+      assignedValue = value;
+    }
+  }
+
+  // Collect the values of the tuples with all the assigned cells' values
+  if (numAssigned == 1)
+    masks = SINGLE_MASKS(table, assignedPosition, assignedValue);
+  else if (numAssigned > 1) {
+    masks = supportedMasks;
+    memset(supportedMasks, 0, sizeof(domain_t) * table->numCells);
+
+    for (j = 0; j < table->numWords; j++) {
+      word = assignedSets[0][j];
+      for (i = 1; i < numAssigned; i++)
+        word &= assignedSets[i][j];
+
+      for (; word; word &= word - 1) {
+        tuple = &(table->tuples[(64 * j + __builtin_ctzll(word)) *
+                                table->numCells]);
+        for (i = 0; i < table->numCells; i++)
+          supportedMasks[i] |= VALUE_MASK(tuple[i]);
+      }
+    }
+  }
+
+  for (i = 0; i < constraint->cellList.size; i++)
+    setCellMask(solver, listCells[i], constraint->maskIndex,
+                masks[solver->cagePositions[listCells[i]]]);
+}
+
+// Make deductions from a line constraint's unassigned cells. A value only one
+// cell can take must go in that cell (hidden single), and when two cells can
+// only take the same two values, no other cell can take them (naked pair).
+// Returns 0 if the line can not be completed.
+inline int propagateLine(kenken_solver_t* solver, constraint_t* constraint) {
+  cells_t* cells = solver->cells;
+  domain_t** masks = cells->masks;
+  domain_t* deductionMasks = masks[DEDUCTION_MASK_INDEX];
+  int i, j, k, numPairCells = 0;
+  int numCells = constraint->cellList.size;
+  int* listCells = &(cells->listCells[constraint->cellList.offset]);
+  int pairCells[MAX_PROBLEM_SIZE];
+  domain_t possibles[MAX_PROBLEM_SIZE];
+  domain_t once = 0, twice = 0, unplaced, hidden, single, pair;
+
+  if (numCells == 0)
+    return 1;
+
+  // Find the values at least one and at least two cells can take, and the
+  // cells with two possibles
+  for (i = 0; i < numCells; i++) {
+    possibles[i] = POSSIBLES(masks, listCells[i]);
+    twice |= once & possibles[i];
+    once |= possibles[i];
+
+    if (cells->numPossibles[listCells[i]] == 2)
+      pairCells[numPairCells++] = i;
+  }
+
+  // The line's mask of an unassigned cell is the values not yet placed in the
+  // line, which each need a cell
+  unplaced = masks[constraint->maskIndex][listCells[0]];
+  if (once != unplaced)
+    return 0;
+
+  // Restrict each cell with a hidden single to it. Stop after making any
+  // deductions, as the line is queued again with its changed cells.
+  if ((hidden = unplaced & ~twice)) {
+    for (i = 0; i < numCells; i++) {
+      if (!(single = possibles[i] & hidden))
+        continue;
+      if (single & (single - 1))
+        return 0;
+
+      if (single != possibles[i]) {
+        setCellMask(solver, listCells[i], DEDUCTION_MASK_INDEX,
+                    deductionMasks[listCells[i]] & single);
+        numPairCells = 0;
+      }
+    }
+  }
+
+  // Remove the values of each naked pair from the other cells
+  for (i = 0; i < numPairCells; i++) {
+    pair = possibles[pairCells[i]];
+    for (j = i + 1; j < numPairCells && possibles[pairCells[j]] != pair; j++);
+    if (j == numPairCells)
+      continue;
+
+    for (k = 0; k < numCells; k++) {
+      if (k == pairCells[i] || k == pairCells[j] || !(possibles[k] & pair))
+        continue;
+      if (!(possibles[k] & ~pair))
+        return 0;
+
+      setCellMask(solver, listCells[k], DEDUCTION_MASK_INDEX,
+                  deductionMasks[listCells[k]] & ~pair);
+      possibles[k] &= ~pair;
+    }
+  }
+
+  return 1;
+}
 
-  for (i = cellList->start; i != END_NODE; i = (cellList->cells[i]).next) {
-    num = cells[i].numPossibles;
+// Remove the values of a line constraint's unassigned cells that are in no
+// matching of the cells to the values not yet placed in the line (Regin's
+// all-different filtering). The line's last matching is repaired rather than
+// found from scratch. Returns 0 if the line can not be completed.
+inline int matchLine(kenken_solver_t* solver, constraint_t* constraint) {
+  cells_t* cells = solver->cells;
+  domain_t** masks = cells->masks;
+  domain_t* deductionMasks = masks[DEDUCTION_MASK_INDEX];
+  int* matchedValues = cells->matchedValues[constraint->maskIndex];
+  int i, j, value;
+  int numCells = constraint->cellList.size;
+  int* listCells = &(cells->listCells[constraint->cellList.offset]);
+  int matchedCells[MAX_PROBLEM_SIZE + 1];
+  int cellValues[MAX_PROBLEM_SIZE], components[MAX_PROBLEM_SIZE];
+  unsigned int edges[MAX_PROBLEM_SIZE], backEdges[MAX_PROBLEM_SIZE];
+  unsigned int remaining, component;
+  domain_t possibles[MAX_PROBLEM_SIZE];
+  domain_t visited, others, allowed;
+
+  for (value = 0; value <= solver->N; value++)
+    matchedCells[value] = -1;
+
+  // Keep the values cells were last matched to that they can still take
+  for (i = 0; i < numCells; i++) {
+    possibles[i] = POSSIBLES(masks, listCells[i]);
+    value = matchedValues[listCells[i]];
+    cellValues[i] = UNASSIGNED_VALUE;
+
+    if (value != UNASSIGNED_VALUE && (possibles[i] & VALUE_MASK(value)) &&
+        matchedCells[value] < 0) {
+      matchedCells[value] = i;
+      cellValues[i] = value;
+    }
+  }
+
+  // Match the other cells. There are as many cells as values not yet placed,
+  // so every cell and value must be matched.
+  for (i = 0; i < numCells; i++) {
+    visited = 0;
+    if (cellValues[i] == UNASSIGNED_VALUE &&
+        !augmentMatching(i, possibles, matchedCells, cellValues, &visited))
+      return 0;
+  }
+
+  // Cells are joined by an edge to the cells matched to the other values they
+  // can take. A cell can take a value in another matching exactly when the
+  // value's cell is in the same strongly connected component.
+  for (i = 0; i < numCells; i++) {
+    edges[i] = backEdges[i] = 0;
+    matchedValues[listCells[i]] = cellValues[i];
+  }
+  for (i = 0; i < numCells; i++) {
+    others = possibles[i] & ~VALUE_MASK(cellValues[i]);
+    for (; others; others &= others - 1) {
+      j = matchedCells[LOWEST_VALUE(others)];
+      edges[i] |= 1U << j;
+      backEdges[j] |= 1U << i;
+    }
+  }
+
+  // Find each component as the cells both reachable from and reaching its
+  // lowest cell. Nothing can be removed if the first has every cell.
+  remaining = (1U << numCells) - 1;
+  while (remaining) {
+    i = __builtin_ctz(remaining);
+    component = reachCells(i, edges, remaining) &
+                reachCells(i, backEdges, remaining);
+    if (component == (1U << numCells) - 1)
+      return 1;
+
+    remaining &= ~component;
+    for (; component; component &= component - 1)
+      components[__builtin_ctz(component)] = i;
+  }
+
+  for (i = 0; i < numCells; i++) {
+    allowed = VALUE_MASK(cellValues[i]);
+    others = possibles[i] & ~allowed;
+    for (; others; others &= others - 1) {
+      value = LOWEST_VALUE(others);
+      if (components[matchedCells[value]] == components[i])
+        allowed |= VALUE_MASK(value);
+    }
+
+    if (allowed != possibles[i])
+      setCellMask(solver, listCells[i], DEDUCTION_MASK_INDEX,
+                  deductionMasks[listCells[i]] & allowed);
+  }
+
+  return 1;
+}
 
-    for (j = start; j <= end; j++) {
-      flag = cells[i].possibles[j];
-      if (markPossible && flag == NUM_CELL_CONSTRAINTS - 1)
-        num++;
-      if (!markPossible && flag == NUM_CELL_CONSTRAINTS)
-        num--;
+// Find the cells reachable from a cell along edges, only going through cells
+// in within
+inline unsigned int reachCells(int cell, unsigned int* edges,
+                               unsigned int within) {
+  unsigned int reached = 1U << cell, frontier = reached, added;
+
+  while (frontier) {
+    cell = __builtin_ctz(frontier);
+    frontier &= frontier - 1;
+    added = edges[cell] & within & ~reached;
+    reached |= added;
+    frontier |= added;
+  }
+
+  return reached;
+}
+
+// Match an unmatched cell to one of its possibles, moving other cells to other
+// values along an augmenting path. Values in visited are not tried. Returns
+// whether the cell was matched.
+int augmentMatching(int cell, domain_t* possibles, int* matchedCells,
+                    int* cellValues, domain_t* visitedPtr) {
+  int value;
+  domain_t candidates = possibles[cell] & ~(*visitedPtr);
+
+  for (; candidates; candidates &= candidates - 1) {
+    value = LOWEST_VALUE(candidates);
+    if (*visitedPtr & VALUE_MASK(value))
+      continue;
 
-      cells[i].possibles[j] = (char)(flag + (markPossible ? 1 : -1));
+    *visitedPtr |= VALUE_MASK(value);
+    if (matchedCells[value] < 0 ||
+        augmentMatching(matchedCells[value], possibles, matchedCells,
+                        cellValues, visitedPtr)) {
+      matchedCells[value] = cell;
+      cellValues[cell] = value;
+      return 1;
     }
+  }
+
+  return 0;
+}
 
-    cells[i].numPossibles = num;
+// Set a cell's mask for a constraint, updating its number of possibles
+inline void setCellMask(kenken_solver_t* solver, int cellIndex, int maskIndex,
+                        domain_t mask) {
+  cells_t* cells = solver->cells;
+  domain_t** masks = cells->masks;
+  domain_t oldPossibles, possibles;
+
+  if (masks[maskIndex][cellIndex] == mask)
+    return;
+
+  if (solver->trail)
+    recordChange(solver, TRAIL_MASK, cellIndex, maskIndex,
+                 masks[maskIndex][cellIndex]);
+  if (maskIndex == DEDUCTION_MASK_INDEX && solver->useBackjumping)
+    addDeductionCells(solver, cellIndex);
+  oldPossibles = POSSIBLES(masks, cellIndex);
+  masks[maskIndex][cellIndex] = mask;
+  possibles = POSSIBLES(masks, cellIndex);
+  updateNumPossibles(solver, cellIndex, POPCOUNT(possibles));
+
+  // Cells only gain possibles when returning to a state that was already
+  // propagated, so only queue the cell's lines when it loses possibles
+  if (oldPossibles & ~possibles)
+    solver->lineQueue |= LINE_BITS(cells->constraintIndexes, cellIndex);
+}
+
+// Set the number of possibles of a cell, moving it to its new bucket
+inline void updateNumPossibles(kenken_solver_t* solver, int cellIndex,
+                               int numPossibles) {
+  cells_t* cells = solver->cells;
+  if (solver->trail && cells->numPossibles[cellIndex] != numPossibles)
+    recordChange(solver, TRAIL_NUM_POSSIBLES, cellIndex, 0,
+                 cells->numPossibles[cellIndex]);
+
+  if (!solver->useBuckets) {
+    cells->numPossibles[cellIndex] = numPossibles;
+    return;
   }
+
+  if (cells->numPossibles[cellIndex] == numPossibles)
+    return;
+
+  removeFromBucket(solver, cellIndex);
+  cells->numPossibles[cellIndex] = numPossibles;
+  addToBucket(solver, cellIndex);
 }
 
+#ifdef AVX2_KERNELS
+// AVX2 version of notifyCellsOfChanges for a row constraint. A row's cells are
+// contiguous, and a cell is in the row's cell list exactly when it is
+// unassigned, so all cells in the list are updated at once.
+__attribute__((target("avx2")))
+void notifyRowOfChangesAvx2(kenken_solver_t* solver, int row, domain_t keep,
+                            domain_t set) {
+  cells_t* cells = solver->cells;
+  int i, start = row * solver->N;
+  int changed, lost, numPossibles[16];
+  __m256i values0, values1, active0, active1, active, masks, possibles, counts;
+  __m256i counts0, counts1, otherMasks;
+
+  // Lookup table of the number of bits set in each 4-bit number
+  const __m256i nibbleCounts = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                                1, 2, 2, 3, 2, 3, 3, 4,
+                                                0, 1, 1, 2, 1, 2, 2, 3,
+                                                1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i lowNibbles = _mm256_set1_epi8(0x0F);
+  const __m256i lanes16 = _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+                                            11, 12, 13, 14, 15);
+  const __m256i lanes32 = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i n = _mm256_set1_epi16((short)solver->N);
+
+  // Find unassigned cells, ignoring lanes past the end of the row
+  values0 = _mm256_loadu_si256((__m256i*)&(cells->values[start]));
+  values1 = _mm256_loadu_si256((__m256i*)&(cells->values[start + 8]));
+  active0 = _mm256_and_si256(_mm256_cmpeq_epi32(values0, zero),
+      _mm256_cmpgt_epi32(_mm256_set1_epi32(solver->N), lanes32));
+  active1 = _mm256_and_si256(_mm256_cmpeq_epi32(values1, zero),
+      _mm256_cmpgt_epi32(_mm256_set1_epi32(solver->N - 8), lanes32));
+  active = _mm256_permute4x64_epi64(_mm256_packs_epi32(active0, active1),
+                                    0xD8);
+  active = _mm256_and_si256(active, _mm256_cmpgt_epi16(n, lanes16));
+
+  // Update the row masks of the active cells
+  masks = _mm256_loadu_si256(
+      (__m256i*)&(cells->masks[ROW_CONSTRAINT_INDEX][start]));
+  otherMasks = _mm256_and_si256(_mm256_and_si256(_mm256_loadu_si256(
+      (__m256i*)&(cells->masks[COLUMN_CONSTRAINT_INDEX][start])),
+      _mm256_loadu_si256(
+      (__m256i*)&(cells->masks[BLOCK_CONSTRAINT_INDEX][start]))),
+      _mm256_loadu_si256(
+      (__m256i*)&(cells->masks[DEDUCTION_MASK_INDEX][start])));
+  possibles = _mm256_and_si256(masks, otherMasks);
+  masks = _mm256_blendv_epi8(masks, _mm256_or_si256(_mm256_and_si256(masks,
+      _mm256_set1_epi16((short)keep)), _mm256_set1_epi16((short)set)), active);
+  _mm256_storeu_si256((__m256i*)&(cells->masks[ROW_CONSTRAINT_INDEX][start]),
+                      masks);
+
+  // Queue the row and the columns of the cells that lost possibles (two bits
+  // per cell) for propagation
+  lost = ~_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_andnot_si256(
+      masks, possibles), zero)) & 0x55555555;
+  if (lost)
+    solver->lineQueue |= 1ULL << row;
+  for (; lost; lost &= lost - 1)
+    solver->lineQueue |= 1ULL << (solver->N + __builtin_ctz(lost) / 2);
+
+  // Count the possibles of each cell, a nibble at a time
+  possibles = _mm256_and_si256(masks, otherMasks);
+  counts = _mm256_add_epi8(
+      _mm256_shuffle_epi8(nibbleCounts, _mm256_and_si256(possibles,
+                                                         lowNibbles)),
+      _mm256_shuffle_epi8(nibbleCounts, _mm256_and_si256(
+          _mm256_srli_epi16(possibles, 4), lowNibbles)));
+  counts = _mm256_maddubs_epi16(counts, _mm256_set1_epi8(1));
+
+  counts0 = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(counts));
+  counts1 = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(counts, 1));
+
+  if (!solver->useBuckets) {
+    _mm256_maskstore_epi32(&(cells->numPossibles[start]), active0, counts0);
+    _mm256_maskstore_epi32(&(cells->numPossibles[start + 8]), active1,
+                           counts1);
+    return;
+  }
 
-// Initialize a cell list
-inline void initList(celllist_t* cellList) {
-  cellList->start = END_NODE;
+  // Only move the active cells whose number of possibles changed
+  changed = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_andnot_si256(
+      _mm256_cmpeq_epi32(counts0, _mm256_loadu_si256(
+          (__m256i*)&(cells->numPossibles[start]))), active0)));
+  changed |= _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_andnot_si256(
+      _mm256_cmpeq_epi32(counts1, _mm256_loadu_si256(
+          (__m256i*)&(cells->numPossibles[start + 8]))), active1))) << 8;
+
+  _mm256_storeu_si256((__m256i*)numPossibles, counts0);
+  _mm256_storeu_si256((__m256i*)&(numPossibles[8]), counts1);
+  for (; changed; changed &= changed - 1) {
+    i = __builtin_ctz(changed);
+    updateNumPossibles(solver, start + i, numPossibles[i]);
+  }
 }
+#endif
 
-// Add node to a cell list
-inline void addNode(celllist_t* cellList, int node) {
-  int start = cellList->start;
 
-  cellList->cells[node].previous = END_NODE;
-  cellList->cells[node].next = start;
-  cellList->start = node;
+// Initialize an empty cell list starting at offset in the list pool
+inline void initList(celllist_t* cellList, int offset) {
+  cellList->offset = offset;
+  cellList->size = 0;
+}
 
-  if (start != END_NODE)
-    cellList->cells[start].previous = node;
+// Add node to a constraint's cell list
+inline void addNode(kenken_solver_t* solver, constraint_t* constraint,
+                    int node) {
+  cells_t* cells = solver->cells;
+  celllist_t* cellList = &(constraint->cellList);
 
+  cells->listCells[cellList->offset + cellList->size] = node;
+  cells->listPositions[constraint->maskIndex][node] = cellList->size;
   ++(cellList->size);
 }
 
-// Remove a node from a cell list
-inline void removeNode(celllist_t* cellList, int node) {
-  int previous = cellList->cells[node].previous;
-  int next = cellList->cells[node].next;
+// Remove a node from a constraint's cell list, moving the last node into its
+// place
+inline void removeNode(kenken_solver_t* solver, constraint_t* constraint,
+                       int node) {
+  cells_t* cells = solver->cells;
+  celllist_t* cellList = &(constraint->cellList);
+  int* listCells = &(cells->listCells[cellList->offset]);
+  int* positions = cells->listPositions[constraint->maskIndex];
+  int position = positions[node];
+  int last = listCells[--(cellList->size)];
+
+  listCells[position] = last;
+  positions[last] = position;
+}
+
+// Add a cell back to its constraints' cell lists and its bucket
+inline void addToConstraints(kenken_solver_t* solver, int cellIndex) {
+  cells_t* cells = solver->cells;
+  constraint_t* constraints = solver->constraints;
+  int i;
+
+  if (solver->trail)
+    recordChange(solver, TRAIL_ADD_CELL, cellIndex, 0, 0);
 
-  if (next != END_NODE)
-    cellList->cells[next].previous = previous;
+  for (i = 0; i < NUM_CELL_CONSTRAINTS; i++)
+    addNode(solver, &(constraints[cells->constraintIndexes[i][cellIndex]]),
+            cellIndex);
+  addToBucket(solver, cellIndex);
+}
 
-  if (previous == END_NODE)
-    cellList->start = next;
-  else
-    cellList->cells[previous].next = next;
+// Remove a cell from its constraints' cell lists and its bucket
+inline void removeFromConstraints(kenken_solver_t* solver, int cellIndex) {
+  cells_t* cells = solver->cells;
+  constraint_t* constraints = solver->constraints;
+  int i;
+
+  if (solver->trail)
+    recordChange(solver, TRAIL_REMOVE_CELL, cellIndex, 0, 0);
+
+  removeFromBucket(solver, cellIndex);
+  for (i = 0; i < NUM_CELL_CONSTRAINTS; i++)
+    removeNode(solver, &(constraints[cells->constraintIndexes[i][cellIndex]]),
+               cellIndex);
+}
+
+// Record a change in the cells' trail, growing the trail if it is full
+inline void recordChange(kenken_solver_t* solver, trailtype_t type, int index,
+                         int maskIndex, long oldValue) {
+  trail_t* trail = solver->trail;
+  trailentry_t* entry;
+
+  if (trail->size == trail->capacity) {
+    trail->capacity *= 2;
+    trail->entries = (trailentry_t*)realloc(trail->entries,
+        sizeof(trailentry_t) * trail->capacity);
+    if (!trail->entries)
+      unixError("Failed to grow the trail");
+  }
+
+  entry = &(trail->entries[trail->size++]);
+  entry->type = type;
+  entry->index = index;
+  entry->maskIndex = maskIndex;
+  entry->oldValue = oldValue;
+}
+
+// Set a cell's value, recording the old value in the trail
+inline void setValue(kenken_solver_t* solver, int cellIndex, int value) {
+  cells_t* cells = solver->cells;
+  if (solver->trail)
+    recordChange(solver, TRAIL_VALUE, cellIndex, 0, cells->values[cellIndex]);
+  if (solver->failedStates)
+    updateStateHash(solver, cellIndex, cells->values[cellIndex], value);
+  cells->values[cellIndex] = value;
+
+  if (value == UNASSIGNED_VALUE)
+    REMOVE_FROM_CELL_SET(cells->assignedCells, cellIndex);
+  else {
+    ADD_TO_CELL_SET(cells->assignedCells, cellIndex);
+    cells->assignTimes[cellIndex] = ++(solver->numAssignments);
+  }
+}
+
+// Add a cell to the bucket for its number of possibles
+inline void addToBucket(kenken_solver_t* solver, int cellIndex) {
+  cells_t* cells = solver->cells;
+  int numPossibles = cells->numPossibles[cellIndex];
+  if (!solver->useBuckets)
+    return;
+
+  cells->buckets[numPossibles * BUCKET_WORDS + cellIndex / 64] |=
+      1ULL << (cellIndex % 64);
+}
+
+// Remove a cell from the bucket for its number of possibles
+inline void removeFromBucket(kenken_solver_t* solver, int cellIndex) {
+  cells_t* cells = solver->cells;
+  int numPossibles = cells->numPossibles[cellIndex];
+  if (!solver->useBuckets)
+    return;
 
-  --(cellList->size);
+  cells->buckets[numPossibles * BUCKET_WORDS + cellIndex / 64] &=
+      ~(1ULL << (cellIndex % 64));
 }
 
 // Read line from file into lineBuf, exiting if the read failed
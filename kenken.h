@@ -29,6 +29,50 @@
 // Number of constraints a cell has (1 row constraint, 1 column constraint,
 // 1 block constraint)
 #define NUM_CELL_CONSTRAINTS 3
+// Number of masks a cell has (1 per constraint, and 1 for values ruled out by
+// propagation)
+#define NUM_CELL_MASKS 4
+// Number of line constraints a cell has (1 row constraint, 1 column
+// constraint)
+#define NUM_CELL_LINES 2
+// Maximum number of cells in a cage whose tuples are kept in a table
+#define MAX_TABLE_CELLS 8
+// Maximum number of tuples in a cage's table
+#define MAX_TABLE_TUPLES 8192
+// Number of bytes buffered by a writer before writing to its stream
+#define WRITER_BUFFER_SIZE 65536
+// Maximum line length of input file
+#define MAX_LINE_LEN 2048
+// Max number of nogoods a solver keeps, and of cells in a nogood
+#define MAX_NOGOODS 4096
+#define MAX_NOGOOD_CELLS 32
+// Number of 64-bit words in a set of cells
+#define CELL_SET_WORDS ((MAX_PROBLEM_SIZE * MAX_PROBLEM_SIZE + 63) / 64)
+// Number of hashes in a bucket of the failed-state cache, filling a cache line
+#define FAILED_STATE_BUCKET_SIZE 8
+
+
+// Bitmask of values, where bit i is set if value i is possible (bit 0 is
+// unused). Use the smallest type that can hold MAX_PROBLEM_SIZE values.
+#if MAX_PROBLEM_SIZE < 16
+typedef unsigned short domain_t;
+#elif MAX_PROBLEM_SIZE < 32
+typedef unsigned int domain_t;
+#else
+typedef unsigned long long domain_t;
+#endif
+
+// Mask with only value v set
+#define VALUE_MASK(v) ((domain_t)1 << (v))
+// Mask with values [start, end] set (empty if end < start)
+#define RANGE_MASK(start, end) (((end) < (start)) ? (domain_t)0 : \
+  (domain_t)(((2ULL << (end)) - 1) & ~((1ULL << (start)) - 1)))
+// Number of values set in a mask
+#define POPCOUNT(m) __builtin_popcountll((unsigned long long)(m))
+// Largest value set in a non-empty mask
+#define HIGHEST_VALUE(m) (63 - __builtin_clzll((unsigned long long)(m)))
+// Smallest value set in a non-empty mask
+#define LOWEST_VALUE(m) __builtin_ctzll((unsigned long long)(m))
 
 
 // Type of constraints
@@ -38,84 +82,651 @@ typedef enum {
   MINUS,
   MULTIPLY,
   DIVIDE,
-  SINGLE
+  SINGLE,
+  // Plus or multiply cage whose cells' possibles come from its cage table
+  TABLE
 } type_t;
 
-// A node in a cell list
-typedef struct cellnode {
-  int previous;
-  int next;
-} cellnode_t;
+// Number of types of constraints
+#define NUM_CONSTRAINT_TYPES (TABLE + 1)
 
-// Doubly linked list of cells
+// List of a constraint's cells. The cells are stored densely in the cells'
+// list pool starting at offset, so the list can be scanned with vector loads.
+// Removing a cell moves the last cell in the list into its place.
 typedef struct celllist {
-  int start;
+  int offset;
   int size;
-  cellnode_t cells[MAX_PROBLEM_SIZE * MAX_PROBLEM_SIZE];
 } celllist_t;
 
 // Puzzle constraint
 typedef struct constraint {
   type_t type;
   long value;
+  // Index of this constraint in the constraints array
+  int index;
+  // Index of this constraint's mask in each of its cells
+  int maskIndex;
   celllist_t cellList;
+  // Number of failures the constraint caused, plus 1, for the dom/wdeg cell
+  // order
+  int weight;
+  // Hash of the values of the cage's assigned cells, and its number of
+  // unassigned cells, kept for the failed-state cache
+  unsigned long long assignedHash;
+  int numUnassigned;
 } constraint_t;
 
-// Individual cell in puzzle
-typedef struct cell {
+// Table of the tuples of values a cage's cells can take to reach the cage's
+// target, where cells in the same row or column have different values. A
+// cell's possibles are its values in the tuples that agree with the cage's
+// assigned cells.
+typedef struct cagetable {
+  int numCells;
+  int numTuples;
+  // Number of 64-bit words in a bitset of tuples
+  int numWords;
+  // Cells of the cage, in the order of the values in each tuple
+  int cellIndexes[MAX_TABLE_CELLS];
+  // Values of each tuple, numCells values per tuple
+  unsigned char* tuples;
+  // Bitsets of the tuples with each value at each position, see TUPLE_SET
+  unsigned long long* tupleSets;
+  // Masks of the values at each position over all tuples, and over the tuples
+  // with each value at each position (see SINGLE_MASKS)
+  domain_t initialMasks[MAX_TABLE_CELLS];
+  domain_t* singleMasks;
+} cagetable_t;
+
+// Set of cells, as a bitset of cell indexes
+typedef struct cellset {
+  unsigned long long words[CELL_SET_WORDS];
+} cellset_t;
+
+// Whether a set of cells contains a cell
+#define IN_CELL_SET(s, i) (((s)->words[(i) / 64] >> ((i) % 64)) & 1)
+// Remove all cells from a set of cells, or add every possible cell index
+#define CLEAR_CELL_SET(s) memset((s), 0, sizeof(cellset_t))
+#define FILL_CELL_SET(s) memset((s), 0xff, sizeof(cellset_t))
+
+// Values of cells found to never be part of a solution together
+typedef struct nogood {
+  int numCells;
+  // Position of the cell value the nogood watches
+  int watch;
+  // Whether the nogood failed a search since the clock hand last passed it
+  int used;
+  short cellIndexes[MAX_NOGOOD_CELLS];
+  unsigned char values[MAX_NOGOOD_CELLS];
+} nogood_t;
+
+// Nogoods learned by a solver. Each nogood watches one of its cell values,
+// which its cell does not have except while the nogood is checked, so a
+// nogood only needs checking when its watched value is assigned. Once full,
+// the nogood under the clock hand is forgotten for each new one, unless it was
+// used since the hand last passed it.
+typedef struct nogoods {
+  int size;
+  int hand;
+  nogood_t nogoods[MAX_NOGOODS];
+  // Links of the lists of nogoods watching each cell value, and the first
+  // nogood in each list. Lists are ended by -1.
+  int next[MAX_NOGOODS];
+  int prev[MAX_NOGOODS];
+  int heads[MAX_PROBLEM_SIZE * MAX_PROBLEM_SIZE * (MAX_PROBLEM_SIZE + 1)];
+} nogoods_t;
+
+// Cache of the hashes of states searched without finding a solution, shared
+// by a solver's clones. A hash is kept in the bucket picked by its low bits,
+// replacing an entry picked by its high bits once the bucket is full. Entries
+// are read and written atomically without locks, and 0 is an empty entry.
+typedef struct failedstates {
+  unsigned long long numBuckets;
+  unsigned long long* entries;
+} failedstates_t;
+
+// Types of changes recorded in a trail
+typedef enum {
+  TRAIL_MASK,
+  TRAIL_NUM_POSSIBLES,
+  TRAIL_VALUE,
+  TRAIL_CONSTRAINT_VALUE,
+  TRAIL_REMOVE_CELL,
+  TRAIL_ADD_CELL,
+  TRAIL_DEDUCTION_CELLS
+} trailtype_t;
+
+// A single change recorded in a trail, with the state before the change
+typedef struct trailentry {
+  trailtype_t type;
+  // Index of the changed cell, or constraint for TRAIL_CONSTRAINT_VALUE
+  int index;
+  // Which of the cell's masks changed for TRAIL_MASK, or which word of its
+  // deduction cells for TRAIL_DEDUCTION_CELLS
+  int maskIndex;
+  long oldValue;
+} trailentry_t;
+
+// Trail (undo log) of changes made to cells and constraints, so all changes
+// since an earlier size of the trail can be undone
+typedef struct trail {
+  int size;
+  int capacity;
+  trailentry_t* entries;
+} trail_t;
+
+// How line constraints are propagated before choosing each cell
+typedef enum {
+  // Don't propagate (default for small problems)
+  NO_PROPAGATION,
+  // Hidden singles and naked pairs (default)
+  SUBSET_PROPAGATION,
+  // Remove values in no matching of cells to values (--alldifferent)
+  MATCHING_PROPAGATION
+} propagation_t;
+
+// How the next cell to fill in is chosen, among the unassigned cells. Cells
+// with one possible are always chosen first.
+typedef enum {
+  // Fewest possibles, then lowest index (default, --order mrv)
+  MIN_POSSIBLES_ORDER,
+  // Fewest possibles, then fewest unassigned cells in its cage (--order cage)
+  CAGE_ORDER,
+  // Lowest possibles divided by unassigned cells sharing a constraint with it
+  // (--order domdeg)
+  DOM_DEG_ORDER,
+  // Lowest possibles divided by weight of its constraints with unassigned
+  // cells, where each constraint's weight counts its failures (--order
+  // domwdeg)
+  DOM_WDEG_ORDER
+} cellorder_t;
+
+// Order a cell's values are tried in
+typedef enum {
+  // Largest value first (default)
+  DESCENDING_VALUE_ORDER,
+  // Value removing the fewest possibles from the cell's neighbours first
+  // (--lcv)
+  LEAST_CONSTRAINING_VALUE_ORDER,
+  // Values shuffled by the solver's seed (used by portfolio solvers)
+  RANDOM_VALUE_ORDER
+} valueorder_t;
+
+// Search options given on the command line, applied to every solver
+typedef struct searchoptions {
+  int useMatching;
+  int useBackjumping;
+  // Megabytes of the failed-state cache, or 0 for none
+  int cacheSize;
+  cellorder_t cellOrder;
+  valueorder_t valueOrder;
+} searchoptions_t;
+
+// Which solutions the solvers search for
+typedef enum {
+  // Stop at the first solution (default)
+  FIRST_SOLUTION,
+  // Count all solutions (--count)
+  COUNT_SOLUTIONS,
+  // Stop at the second solution, to check a solution is unique (--unique)
+  UNIQUE_SOLUTION,
+  // Print all solutions (--all)
+  ALL_SOLUTIONS
+} solvemode_t;
+
+// Counters of the work done by a solver, kept while the solver has stats
+typedef struct solverstats {
+  // Failures from a cell without possibles, split by whether its cage allows
+  // none of its values, or only its lines and deductions rule them all out
+  long long cageViolations;
+  long long emptyDomains;
+  // Failures from propagating a line, completing a learned nogood, and
+  // finding the state in the failed-state cache
+  long long lineFailures;
+  long long nogoodFailures;
+  long long cachedFailures;
+  // Number of updates of constraints of each type, and of lines propagated
+  long long updates[NUM_CONSTRAINT_TYPES];
+  long long linePropagations;
+} solverstats_t;
+
+// Hardware events counted by a thread's performance counters
+typedef enum {
+  CYCLES_COUNTER,
+  INSTRUCTIONS_COUNTER,
+  L1D_MISSES_COUNTER,
+  LLC_MISSES_COUNTER,
+  BRANCH_MISSES_COUNTER,
+  NUM_PERF_COUNTERS
+} perfcounter_t;
+
+// Hardware performance counters of one thread, opened with perf_event_open on
+// Linux (--perf-counters). Counters the kernel or processor does not support
+// are not opened.
+typedef struct perfcounters {
+  // File descriptor of each counter, or -1 if it is not open
+  int fds[NUM_PERF_COUNTERS];
+  // Count of each event while the counters were enabled, scaled up if the
+  // kernel shared the hardware between counters, or -1 if not counted
+  long long counts[NUM_PERF_COUNTERS];
+} perfcounters_t;
+
+// Buffered writer of solutions to a stream. Each solution is written to the
+// stream as a whole, so writers can share a stream across threads.
+typedef struct writer {
+  FILE* out;
+  int size;
+  char buffer[WRITER_BUFFER_SIZE];
+} writer_t;
+
+// Text of a puzzle, as read by readPuzzleText
+typedef struct puzzletext {
+  char* text;
+  size_t size;
+  size_t capacity;
+} puzzletext_t;
+
+// Assignment of a value to a cell
+typedef struct assignment {
+  int cellIndex;
   int value;
-  int numPossibles;
-  char possibles[MAX_PROBLEM_SIZE + 1];
-  int constraintIndexes[NUM_CELL_CONSTRAINTS];
-} cell_t;
+} assignment_t;
+
+// Job of a split search: the assignments leading from the root state to the
+// node the job searches
+typedef struct job {
+  int length;
+  assignment_t assignments[MAX_PROBLEM_SIZE * MAX_PROBLEM_SIZE];
+} job_t;
+
+// Puzzle cells, stored as a structure of arrays so each field is contiguous
+// and aligned for vector loads. Each of a cell's constraints keeps its own
+// mask of values it allows, and values ruled out by propagation are cleared
+// from one more mask, so the cell's possibles are the AND of the masks. All
+// arrays share one allocation, so cells can be copied with one memcpy.
+typedef struct cells {
+  int* values;
+  int* numPossibles;
+  domain_t* masks[NUM_CELL_MASKS];
+  int* constraintIndexes[NUM_CELL_CONSTRAINTS];
+  // Value each cell was matched to the last time each of its lines was
+  // propagated by matching
+  int* matchedValues[NUM_CELL_LINES];
+  // Pool of all constraints' cell lists, and each cell's position in the cell
+  // list of each of its constraints
+  int* listCells;
+  int* listPositions[NUM_CELL_CONSTRAINTS];
+  // Cells in their constraints' cell lists, grouped into buckets by number
+  // of possibles. Each bucket is a bitset of cell indexes.
+  unsigned long long* buckets;
+  // Values of each cell in the order they are tried, ended by
+  // UNASSIGNED_VALUE, when not trying the largest value first
+  unsigned char* valueOrders;
+  // Assigned cells, the cell assigned each value in each line (only valid
+  // while the value is assigned), and when each cell was last assigned
+  cellset_t* assignedCells;
+  int* valueCells;
+  long long* assignTimes;
+  // Assigned cells whose values caused each cell's deductions, when
+  // backjumping
+  cellset_t* deductionCells;
+  void* data;
+} cells_t;
+
+// Solver context for one puzzle. It owns the puzzle's cells and constraints,
+// and the lookup tables used while solving. A solver is only used by one
+// thread at a time, so each thread solving the same puzzle uses its own clone.
+typedef struct kenken_solver {
+  // Problem size
+  int N;
+  // Total number of cells in the problem
+  int totalNumCells;
+  // Number of constraints
+  int numConstraints;
+  cells_t* cells;
+  constraint_t* constraints;
+  // Trail to record changes in, or NULL if changes are not recorded
+  trail_t* trail;
+  // Max number by multiplying, shared by the solver's clones
+  long* maxMultiply;
+  // Table of each TABLE constraint (NULL for other constraints), and the
+  // position of each cell in its cage's table, shared by the solver's clones
+  cagetable_t** cageTables;
+  int* cagePositions;
+  // Number of bytes in the data of the cells
+  size_t cellsDataSize;
+  // Whether to use the AVX2 kernel when notifying cells of changes
+  int useAvx2;
+  // Whether to keep cells in buckets by number of possibles
+  int useBuckets;
+  // How to propagate line constraints before choosing each cell
+  propagation_t linePropagation;
+  // How to choose the next cell to fill in, and order its values
+  cellorder_t cellOrder;
+  valueorder_t valueOrder;
+  // Seed of the solver's random choices
+  unsigned int seed;
+  // Bitset of the line constraints whose cells changed since they were last
+  // propagated
+  unsigned long long lineQueue;
+  // Whether to jump back over cells whose values did not cause a failure,
+  // learning the values that did as nogoods
+  int useBackjumping;
+  // Cells of each constraint, shared by the solver's clones
+  cellset_t* constraintCells;
+  // Assigned cells whose values caused the last failure in propagate,
+  // getNextCellToFill or isFailedState
+  cellset_t failure;
+  // Line being propagated, and whether lineConflict holds the assigned cells
+  // whose values caused its deductions
+  constraint_t* propagatingLine;
+  int lineExplained;
+  cellset_t lineConflict;
+  // Nogoods learned while backjumping, or NULL if not backjumping
+  nogoods_t* nogoods;
+  // Number of values assigned so far, which orders the assign times
+  long long numAssignments;
+  // Cache of failed states, and the random keys hashed into a state, shared
+  // by the solver's clones, or NULL if states are not cached
+  failedstates_t* failedStates;
+  unsigned long long* stateKeys;
+  // Hash of the state: which cells are assigned, the values assigned in each
+  // line, and the values assigned in each cage with unassigned cells. States
+  // with the same hash leave the same problem for their unassigned cells, so
+  // either both or neither have a solution.
+  unsigned long long stateHash;
+  // Number of failed-state cache lookups that found or missed the state
+  long long cacheHits;
+  long long cacheMisses;
+  // Counters to add the solver's work to, or NULL if it is not counted. Clones
+  // start without counters, so each thread can count its own.
+  solverstats_t* stats;
+  // Whether the solver is a clone, so does not own the lookup tables
+  int isClone;
+} kenken_solver_t;
+
+// Search of the nodes below a solver's state by searchNode. The counters are
+// added to as the search goes. The hooks are optional (NULL), and let a
+// caller stop the search early, or count solutions shared with other searches.
+typedef struct search {
+  kenken_solver_t* solver;
+  // Trail the deductions made by propagation are recorded in
+  trail_t* trail;
+  // Which solutions to search for, and the writer of the solutions written
+  solvemode_t mode;
+  writer_t* writer;
+  // Number of nodes visited and solutions found
+  long long* nodeCount;
+  long long* numSolutions;
+  // The search stops once nodeCount reaches nodeLimit
+  long long nodeLimit;
+  // Called before searching each node, with the node's step. Returns whether
+  // the search should stop at the node.
+  int (*stopNode)(struct search* search, int step);
+  // Called after each solution is added to numSolutions. Returns the number
+  // of solutions deciding whether the solution is written and the search
+  // stops, which is numSolutions without the hook.
+  long long (*countSolution)(struct search* search);
+  // Data of the caller, for the hooks
+  void* data;
+  // Assignments of the nodes on the search's current path, indexed by step,
+  // and the possibles of each node's cell before its values were tried. Only
+  // recorded if path is not NULL.
+  assignment_t* path;
+  domain_t* pathPossibles;
+} search_t;
+
+
+// Given an input file name, create a solver with the puzzle's cells and
+// constraints initialized
+kenken_solver_t* createSolver(char* file);
+
+// Same as createSolver, except the puzzle is read from the current position
+// of a stream, leaving the stream at the line after the puzzle's constraints
+kenken_solver_t* readSolver(FILE* in);
+
+// Allocate an empty puzzle text
+puzzletext_t* allocatePuzzleText();
+
+// Free a puzzle text
+void freePuzzleText(puzzletext_t* puzzle);
+
+// Read the text of the next puzzle in a stream into puzzle: the lines
+// readSolver reads, which are its problem size, constraints and any given
+// values, but not its answer. Lines before the problem size, such as blank
+// lines and the answers puzzle files can end with, are skipped. Returns 0 if
+// there are no puzzles left in the stream.
+int readPuzzleText(FILE* in, puzzletext_t* puzzle);
 
+// Create a clone of a solver, with its own copy of the cells and constraints
+// and sharing the lookup tables. The solver must outlive its clones.
+kenken_solver_t* cloneSolver(kenken_solver_t* solver);
 
-// Problem size
-int N;
-// Total number of cells in the problem
-int totalNumCells;
-// Number of constraints
-int numConstraints;
+// Copy the state of the cells and constraints of src to dest, a clone of src
+// or a solver src is cloned from
+void copySolver(kenken_solver_t* dest, kenken_solver_t* src);
 
+// Free a solver, and the lookup tables if it is not a clone
+void freeSolver(kenken_solver_t* solver);
 
-// Given an input file name, initialize cells and constraints and global
-// variables. Note, this should only be called once at beginning of program.
-// The constraints and cells results can be memcpy'ed if need be.
-void initialize(char* file, cell_t** cellPtr, constraint_t** constraintsPtr);
+// Allocate an empty trail. Changes to a solver's cells and constraints are
+// recorded in the trail while it is set as the solver's trail.
+trail_t* allocateTrail();
+
+// Free a trail
+void freeTrail(trail_t* trail);
+
+// Undo the changes recorded in the trail until it is back to size mark
+void undoTrail(kenken_solver_t* solver, trail_t* trail, int mark);
+
+// Make deductions from the line constraints queued for propagation until no
+// more can be made, recording the changes in trail so they can be undone.
+// Returns 0 if the puzzle is found to be in an impossible state.
+int propagate(kenken_solver_t* solver, trail_t* trail);
+
+// Queue all line constraints for propagation, after the cells were changed
+// without being propagated
+void queueAllLines(kenken_solver_t* solver);
 
 // Get number of possibles for a specific cell
-inline int getNumPossibles(cell_t* cells, int cellIndex);
+inline int getNumPossibles(kenken_solver_t* solver, int cellIndex);
+
+// Get the possible values of a cell
+inline domain_t getPossibles(kenken_solver_t* solver, int cellIndex);
 
 // Apply a value to a specific cell, updating its constraints
-inline void applyValue(cell_t* cells, constraint_t* constraints, int cellIndex,
-                       int value);
+inline void applyValue(kenken_solver_t* solver, int cellIndex, int value);
 
 // Get the next cell to fill in, remove it from its constraints, and return its
 // index. The next cell is unassigned cell with the minimum number of
 // possibilities. If puzzle is in impossible state return IMPOSSIBLE_STATE.
-inline int getNextCellToFill(cell_t* cells, constraint_t* constraints);
+inline int getNextCellToFill(kenken_solver_t* solver);
 
 // Same as getNextCellToFill, except it imposes a max number of possibles
 // allowed for the chosen cell. If the next cell has too many possibles,
 // return TOO_MANY_POSSIBLES.
-inline int getNextCellToFillN(cell_t* cells, constraint_t* constraints,
-                              int maxPossibles);
+inline int getNextCellToFillN(kenken_solver_t* solver, int maxPossibles);
 
 // Apply and return next value for the cell currently filling in. On first time
 // called for a specific cell, previousValue should be UNASSIGNED_VALUE. When
 // there are no more values to fill in, unassign the value, add the cell back
 // to its constraints and return UNASSIGNED_VALUE.
-inline int applyNextValue(cell_t* cells, constraint_t* constraints,
-                          int cellIndex, int previousValue);
+inline int applyNextValue(kenken_solver_t* solver, int cellIndex,
+                          int previousValue);
+
+// Unassign a cell's value, and add the cell back to its constraints, without
+// trying its remaining values
+inline void unassignCell(kenken_solver_t* solver, int cellIndex, int value);
+
+// Get the values applyNextValue would still try for a cell assigned value, in
+// the order it would try them, given the cell's possibles before its first
+// value was applied. Only valid until the cell's next value is applied.
+// Returns the number of values.
+int getUntriedValues(kenken_solver_t* solver, int cellIndex,
+                     domain_t possibles, int value, int* values);
+
+// Conflict-directed backjumping. A node's conflict is the set of assigned
+// cells whose values caused the search from the node to fail, so the search
+// can jump back to the last of these cells, skipping the nodes between. These
+// functions do nothing unless the solver is backjumping.
+
+// Set conflict to the cells whose values caused the last failure in
+// propagate, getNextCellToFill or isFailedState
+void explainFailure(kenken_solver_t* solver, cellset_t* conflict);
+
+// Check whether the value just applied to a cell completes a learned nogood.
+// If so, set conflict to the nogood's cells and return 1.
+int checkNogoods(kenken_solver_t* solver, int cellIndex, cellset_t* conflict);
+
+// After the search from a cell's value fails with childConflict, add it to the
+// conflict of the cell's node. If the cell is not in childConflict, the node
+// can be jumped over: the cell is unassigned, the node's conflict is set to
+// childConflict, and 1 is returned.
+int backjump(kenken_solver_t* solver, int cellIndex, int value,
+             cellset_t* childConflict, cellset_t* conflict);
+
+// After all of a cell's values failed, add the cells whose values removed its
+// other possibles to the conflict of its node, and learn the conflict as a
+// nogood if it is small enough
+void learnConflict(kenken_solver_t* solver, int cellIndex, cellset_t* conflict);
+
+// Forget the nogoods a solver learned, so its search does not depend on what
+// it searched before
+void clearNogoods(kenken_solver_t* solver);
+
+// Check whether the solver's state was already searched without finding a
+// solution, in which case explainFailure gives the assigned cells as the
+// conflict. Does nothing unless the solver caches failed states.
+int isFailedState(kenken_solver_t* solver);
+
+// Add the solver's state to the failed-state cache, after searching it without
+// finding a solution
+void addFailedState(kenken_solver_t* solver);
 
 // Print solution to stdout
-void printSolution(cell_t* cells);
+void printSolution(kenken_solver_t* solver);
+
+// Remove the solve mode option (if any) from the command line arguments and
+// return the mode, or -1 if an option is not recognized
+int getSolveMode(int* argcPtr, char** argv);
+
+// Remove all occurrences of an option from the command line arguments, and
+// return whether it was given
+int removeOption(int* argcPtr, char** argv, char* option);
+
+// Remove an option and the value after it from the command line arguments,
+// and return the value. Returns NULL if the option was not given, or the empty
+// string if it has no value.
+char* removeOptionValue(int* argcPtr, char** argv, char* option);
+
+// Remove the search options (if any) from the command line arguments and
+// return them in options. Returns 0 if an option's value is not recognized.
+int getSearchOptions(int* argcPtr, char** argv, searchoptions_t* options);
+
+// Use search options in a solver. Clones get the options of their solver.
+void setSearchOptions(kenken_solver_t* solver, searchoptions_t* options);
+
+// Usage of the search options, to print after a program's usage line
+#define SEARCH_OPTIONS_USAGE \
+  "Search options: [--alldifferent] [--order mrv | cage | domdeg | domwdeg] " \
+  "[--lcv] [--backjump] [--cache MB]\n"
+
+// Whether the numSolutions-th solution found should be written in given mode
+#define WRITE_SOLUTION(mode, numSolutions) ((mode) == ALL_SOLUTIONS || \
+  ((mode) != COUNT_SOLUTIONS && (numSolutions) == 1))
+
+// Whether the search should stop after finding numSolutions in given mode
+#define STOP_SEARCH(mode, numSolutions) \
+  (((mode) == FIRST_SOLUTION && (numSolutions) >= 1) || \
+   ((mode) == UNIQUE_SOLUTION && (numSolutions) >= 2))
+
+// Allocate an empty writer to the given stream
+writer_t* allocateWriter(FILE* out);
+
+// Write solution to writer, separating solutions with a blank line when
+// writing all solutions
+void writeSolution(writer_t* writer, kenken_solver_t* solver,
+                   solvemode_t mode);
+
+// Flush and free a writer
+void freeWriter(writer_t* writer);
+
+// Write everything buffered in writer to its stream
+void flushWriter(writer_t* writer);
+
+// Initialize a search of a solver's nodes, with no node limit, no hooks and
+// no path recorded
+void initSearch(search_t* search, kenken_solver_t* solver, trail_t* trail,
+                solvemode_t mode, writer_t* writer, long long* nodeCount,
+                long long* numSolutions);
+
+// Search the nodes below the solver's state, where step cells are assigned,
+// writing the solutions found. The deductions made are undone unless the
+// search stops. Returns whether the search should stop. When backjumping,
+// conflict is set to the cells whose values caused the search to fail.
+int searchNode(search_t* search, int step, cellset_t* conflict);
+
+// Copy a job into dest. Returns 0 if the job's length is invalid, which can
+// only happen if another thread is overwriting the job.
+int copyJob(job_t* dest, job_t* job);
+
+// Load a job into mySolver, a clone of solver or the solver it is cloned
+// from, by applying the job's assignments to solver's state. The trail is
+// emptied, and the job's cells are queued for propagation.
+void loadJob(kenken_solver_t* mySolver, kenken_solver_t* solver,
+             trail_t* trail, job_t* job);
+
+// Split the search from solver's state into at least numTarget jobs in the
+// serial search order, if it can be split that far, by splitting jobs on
+// their next cell, shallowest first, with mySolver (see loadJob). Jobs that
+// fail are dropped, and the nodes visited splitting jobs are added to
+// nodeCount. Returns the jobs, and their number in numJobsPtr.
+job_t* splitJobs(kenken_solver_t* solver, kenken_solver_t* mySolver,
+                 trail_t* trail, long numTarget, long* numJobsPtr,
+                 long long* nodeCount);
+
+// Print the number of solutions found to out, unless only searching for the
+// first
+void printSolutionCount(FILE* out, solvemode_t mode, long long numSolutions);
+
+// Print the number of failed-state cache hits and misses to out, if the
+// search options cache failed states
+void printCacheCounts(FILE* out, searchoptions_t* options, long long hits,
+                      long long misses);
+
+// Add the counters of src to dest
+void addSolverStats(solverstats_t* dest, solverstats_t* src);
+
+// Write a solver's counters to out as the last members of a JSON object, with
+// each line starting with indent
+void writeSolverStats(FILE* out, solverstats_t* stats, const char* indent);
+
+
+// Open the calling thread's performance counters, disabled. Returns the number
+// of counters opened.
+int openPerfCounters(perfcounters_t* counters);
+
+// Reset and enable a thread's open performance counters. Only the thread that
+// opened them is counted.
+void startPerfCounters(perfcounters_t* counters);
+
+// Disable a thread's performance counters and read their counts
+void stopPerfCounters(perfcounters_t* counters);
+
+// Close a thread's performance counters, keeping their counts
+void closePerfCounters(perfcounters_t* counters);
+
+// Add the counts of src to dest. A count is -1 if either count is -1.
+void addPerfCounters(perfcounters_t* dest, perfcounters_t* src);
 
+// Print the counts of performance counters to out, and their counts per node
+// visited
+void printPerfCounters(FILE* out, perfcounters_t* counters,
+                       long long nodeCount);
 
 // Print an application error, and exit
-void appError(const char* str);
+void appError(const char* str) __attribute__((noreturn));
 // Print a unix error, and exit
-void unixError(const char* str);
+void unixError(const char* str) __attribute__((noreturn));
 
 #endif
 
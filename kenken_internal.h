@@ -0,0 +1,164 @@
+// ============================================================================
+// Jonathan Park (jjp1)
+// Ben Parr (bparr)
+//
+// File: kenken_internal.h
+// Description: Private header for the functions internal to kenken.c, shared
+//              with the microbenchmarks that time them in isolation.
+//
+// CS418 Project
+// ============================================================================
+
+#ifndef __KENKEN_INTERNAL_H__
+#define __KENKEN_INTERNAL_H__
+
+#include "kenken.h"
+
+// Build the AVX2 kernels when compiling for x86-64 with 16-bit masks
+#if defined(__GNUC__) && defined(__x86_64__) && MAX_PROBLEM_SIZE < 16
+#define AVX2_KERNELS
+#endif
+
+
+// Update constraint from having the cell at cellIndex with value oldCellValue
+// to having the cell assigned newCellValue (valid cell values include
+// UNASSIGNED_VALUE).
+inline void updateConstraint(kenken_solver_t* solver, constraint_t* constraint,
+                             int cellIndex, int oldCellValue,
+                             int newCellValue);
+
+// Funtions to initialize line constraints
+void initRowConstraint(kenken_solver_t* solver, int index, int row);
+void initColumnConstraint(kenken_solver_t* solver, int index, int col);
+
+// Functions to initialize cell's possibles in given constraint
+void initLineCells(kenken_solver_t* solver, constraint_t* constraint);
+void initPlusCells(kenken_solver_t* solver, constraint_t* constraint,
+                   long value, int numCells);
+void initMinusCells(kenken_solver_t* solver, constraint_t* constraint,
+                    long value);
+void initMultiplyCells(kenken_solver_t* solver, constraint_t* constraint,
+                       long value, int numCells);
+void initDivideCells(kenken_solver_t* solver, constraint_t* constraint,
+                     long value);
+void initSingleCells(kenken_solver_t* solver, constraint_t* constraint,
+                     long value);
+void initTableCells(kenken_solver_t* solver, constraint_t* constraint);
+
+// Cage table functions
+cagetable_t* createCageTable(kenken_solver_t* solver, constraint_t* constraint,
+                             type_t type, long value);
+int addCageTuples(kenken_solver_t* solver, cagetable_t* table, type_t type,
+                  long remaining, int position, unsigned char* values,
+                  int* capacityPtr);
+void freeCageTable(cagetable_t* table);
+
+// Helper functions used when updating cell's possibles
+inline void updatePlusCells(kenken_solver_t* solver, constraint_t* constraint,
+                            long oldValue, int oldNumCells, long newValue,
+                            int newNumCells);
+inline void initMinusCellsHelper(kenken_solver_t* solver,
+                                 constraint_t* constraint, long value,
+                                 char markPossible);
+inline void initPartialMinusCells(kenken_solver_t* solver,
+                                  constraint_t* constraint, long value,
+                                  int cellValue, char markPossible);
+inline void updateMultiplyCells(kenken_solver_t* solver,
+                                constraint_t* constraint, long oldValue,
+                                int oldNumCells, long newValue,
+                                int newNumCells);
+inline void initDivideCellsHelper(kenken_solver_t* solver,
+                                  constraint_t* constraint, long value,
+                                  char markPossible);
+inline void initPartialDivideCells(kenken_solver_t* solver,
+                                   constraint_t* constraint, long value,
+                                   int cellValue, char markPossible);
+inline domain_t getMultiplyMask(kenken_solver_t* solver, long value,
+                                int numCells);
+inline void notifyCellsOfChange(kenken_solver_t* solver,
+                                constraint_t* constraint, int value,
+                                char markPossible);
+inline void notifyCellsOfChanges(kenken_solver_t* solver,
+                                 constraint_t* constraint, domain_t changes,
+                                 char markPossible);
+inline void updateTableCells(kenken_solver_t* solver,
+                             constraint_t* constraint, int cellIndex,
+                             int newCellValue);
+inline void setCellMask(kenken_solver_t* solver, int cellIndex, int maskIndex,
+                        domain_t mask);
+inline void updateNumPossibles(kenken_solver_t* solver, int cellIndex,
+                               int numPossibles);
+inline int propagateLine(kenken_solver_t* solver, constraint_t* constraint);
+inline int matchLine(kenken_solver_t* solver, constraint_t* constraint);
+int augmentMatching(int cell, domain_t* possibles, int* matchedCells,
+                    int* cellValues, domain_t* visitedPtr);
+inline unsigned int reachCells(int cell, unsigned int* edges,
+                               unsigned int within);
+#ifdef AVX2_KERNELS
+void notifyRowOfChangesAvx2(kenken_solver_t* solver, int row, domain_t keep,
+                            domain_t set);
+#endif
+
+// Cell list functions
+inline void initList(celllist_t* cellList, int offset);
+inline void addNode(kenken_solver_t* solver, constraint_t* constraint,
+                    int node);
+inline void removeNode(kenken_solver_t* solver, constraint_t* constraint,
+                       int node);
+
+// Functions to add or remove a cell from its constraints' cell lists
+inline void addToConstraints(kenken_solver_t* solver, int cellIndex);
+inline void removeFromConstraints(kenken_solver_t* solver, int cellIndex);
+
+// Trail functions
+inline void recordChange(kenken_solver_t* solver, trailtype_t type, int index,
+                         int maskIndex, long oldValue);
+inline void setValue(kenken_solver_t* solver, int cellIndex, int value);
+
+// Bucket functions
+inline void addToBucket(kenken_solver_t* solver, int cellIndex);
+inline void removeFromBucket(kenken_solver_t* solver, int cellIndex);
+inline int findMinCellInBuckets(kenken_solver_t* solver, int* minPossiblesPtr);
+inline int findMinCellByScan(kenken_solver_t* solver, int* minPossiblesPtr);
+
+// Search order functions
+inline int findBestCellInOrder(kenken_solver_t* solver, int* minPossiblesPtr);
+inline int getCellWeight(kenken_solver_t* solver, int cellIndex);
+inline int getNextValueInOrder(kenken_solver_t* solver, int cellIndex,
+                               int previousValue);
+inline int getValueCost(kenken_solver_t* solver, int cellIndex, int value);
+
+// Backjumping functions
+inline void addCellReasons(kenken_solver_t* solver, int cellIndex,
+                           cellset_t* reasons);
+inline void explainCell(kenken_solver_t* solver, int cellIndex,
+                        cellset_t* conflict);
+inline void explainLine(kenken_solver_t* solver, constraint_t* constraint,
+                        cellset_t* conflict);
+inline void addDeductionCells(kenken_solver_t* solver, int cellIndex);
+void learnNogood(kenken_solver_t* solver, cellset_t* conflict);
+inline void watchNogood(nogoods_t* nogoods, int slot);
+inline void unwatchNogood(nogoods_t* nogoods, int slot);
+nogoods_t* allocateNogoods();
+void emptyNogoods(nogoods_t* nogoods);
+
+// Failed-state cache functions
+inline void updateStateHash(kenken_solver_t* solver, int cellIndex,
+                            int oldValue, int newValue);
+inline unsigned long long nextStateKey(unsigned long long* seed);
+void allocateFailedStates(kenken_solver_t* solver, int cacheSize);
+void freeFailedStates(failedstates_t* failedStates);
+
+// Cells functions
+cells_t* allocateCells(kenken_solver_t* solver);
+void freeCells(cells_t* cells);
+
+// Split search functions
+job_t* appendJob(job_t** jobsPtr, long* numJobsPtr, long* capacityPtr,
+                 job_t* job);
+
+// Miscellaneous functions
+void readLine(FILE* in, char* lineBuf);
+void appendPuzzleLine(puzzletext_t* puzzle, char* line);
+
+#endif
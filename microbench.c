@@ -0,0 +1,375 @@
+// ============================================================================
+// Jonathan Park (jjp1)
+// Ben Parr (bparr)
+//
+// File: microbench.c
+// Description: Microbenchmarks of the solver's propagation kernels, run on
+//              board states captured while searching puzzles.
+//
+// CS418 Project
+// ============================================================================
+
+#include "kenken_internal.h"
+#include <time.h>
+
+// Default number of states captured from each puzzle, number of nodes searched
+// to capture them, and times each kernel is repeated on a state
+#define DEFAULT_NUM_STATES 32
+#define DEFAULT_MAX_NODES 10000
+#define DEFAULT_REPEATS 100
+
+// Calculate number of nanoseconds between two timespecs
+#define NANO_DIFF(b, a) (((b).tv_sec - (a).tv_sec) * 1000000000.0 + \
+                         ((b).tv_nsec - (a).tv_nsec))
+
+// Kernels timed. The updateConstraint kernels are indexed by constraint type.
+#define NUM_UPDATE_KERNELS NUM_CONSTRAINT_TYPES
+#define NOTIFY_CHANGE_KERNEL (NUM_UPDATE_KERNELS)
+#define NOTIFY_CHANGES_KERNEL (NUM_UPDATE_KERNELS + 1)
+#define NEXT_CELL_KERNEL (NUM_UPDATE_KERNELS + 2)
+#define NEXT_VALUE_KERNEL (NUM_UPDATE_KERNELS + 3)
+#define LIST_NODE_KERNEL (NUM_UPDATE_KERNELS + 4)
+#define NUM_KERNELS (NUM_UPDATE_KERNELS + 5)
+
+// Algorithm functions
+void captureStates(int step);
+void captureState();
+void timeUpdateConstraint(kenken_solver_t* state);
+void timeNotifyCells(kenken_solver_t* state);
+void timeNextCell(kenken_solver_t* state);
+void timeNextValue(kenken_solver_t* state);
+void timeListNodes(kenken_solver_t* state);
+void printResults();
+void usage(char* program);
+
+
+// Names of the kernels, as printed
+char* kernelNames[NUM_KERNELS] = {
+  "updateConstraint LINE",
+  "updateConstraint PLUS",
+  "updateConstraint MINUS",
+  "updateConstraint MULTIPLY",
+  "updateConstraint DIVIDE",
+  "updateConstraint SINGLE",
+  "updateConstraint TABLE",
+  "notifyCellsOfChange",
+  "notifyCellsOfChanges",
+  "getNextCellToFillN",
+  "applyNextValue",
+  "addNode/removeNode"
+};
+
+// Search options for the solver
+searchoptions_t options;
+// Number of states to capture from each puzzle, nodes to search capturing
+// them, and times each kernel is repeated on a state
+int numStates;
+long long maxNodes;
+int repeats;
+// Solver searching the puzzle, and the trail of its deductions
+kenken_solver_t* solver;
+trail_t* trail;
+// States captured from the puzzle, sampled uniformly from the nodes searched
+kenken_solver_t** states;
+int numCaptured;
+// Solver each kernel is run on, reset to a captured state before each kernel
+kenken_solver_t* work;
+// Number of nodes searched in the puzzle
+long long nodeCount;
+// Seed of the sampling of the states
+unsigned int seed;
+// Operations run and nanoseconds taken by each kernel, for each board size,
+// and the number of puzzles and states timed for each board size
+long long numOps[MAX_PROBLEM_SIZE + 1][NUM_KERNELS];
+double nanosecs[MAX_PROBLEM_SIZE + 1][NUM_KERNELS];
+int numPuzzles[MAX_PROBLEM_SIZE + 1];
+int numSizeStates[MAX_PROBLEM_SIZE + 1];
+
+int main(int argc, char **argv) {
+  int i, j;
+  char* statesOption = removeOptionValue(&argc, argv, "--states");
+  char* nodesOption = removeOptionValue(&argc, argv, "--nodes");
+  char* repeatsOption = removeOptionValue(&argc, argv, "--repeats");
+
+  if (!getSearchOptions(&argc, argv, &options) || argc < 2)
+    usage(argv[0]);
+
+  numStates = statesOption ? atoi(statesOption) : DEFAULT_NUM_STATES;
+  maxNodes = nodesOption ? atoll(nodesOption) : DEFAULT_MAX_NODES;
+  repeats = repeatsOption ? atoi(repeatsOption) : DEFAULT_REPEATS;
+  if (numStates < 1 || maxNodes < 1 || repeats < 1)
+    usage(argv[0]);
+
+  states = (kenken_solver_t**)malloc(sizeof(kenken_solver_t*) * numStates);
+  if (!states)
+    unixError("Failed to allocate memory for the states");
+
+  for (i = 1; i < argc; i++) {
+    solver = createSolver(argv[i]);
+    setSearchOptions(solver, &options);
+    trail = allocateTrail();
+    for (j = 0; j < numStates; j++)
+      states[j] = cloneSolver(solver);
+    work = cloneSolver(solver);
+
+    // Sample the same nodes on every run
+    seed = 1;
+    numCaptured = 0;
+    nodeCount = 0;
+    captureStates(0);
+    fprintf(stderr, "%s (N=%d): captured %d states from %lld nodes\n",
+            argv[i], solver->N, numCaptured, nodeCount);
+
+    for (j = 0; j < numCaptured; j++) {
+      timeUpdateConstraint(states[j]);
+      timeNotifyCells(states[j]);
+      timeNextCell(states[j]);
+      timeNextValue(states[j]);
+      timeListNodes(states[j]);
+    }
+    numPuzzles[solver->N]++;
+    numSizeStates[solver->N] += numCaptured;
+
+    freeSolver(work);
+    for (j = 0; j < numStates; j++)
+      freeSolver(states[j]);
+    freeTrail(trail);
+    freeSolver(solver);
+  }
+
+  printResults();
+  free(states);
+  return 0;
+}
+
+// Search the puzzle like the serial solver, without learning, until maxNodes
+// nodes are searched, capturing the state of each node after its deductions
+// with reservoir sampling
+void captureStates(int step) {
+  int cellIndex;
+  int value = UNASSIGNED_VALUE;
+  int mark = trail->size;
+
+  if (step == solver->totalNumCells || nodeCount >= maxNodes)
+    return;
+
+  nodeCount++;
+  if (propagate(solver, trail)) {
+    captureState();
+    if ((cellIndex = getNextCellToFill(solver)) != IMPOSSIBLE_STATE) {
+      while (UNASSIGNED_VALUE != (value = applyNextValue(solver, cellIndex,
+                                                         value)))
+        captureStates(step + 1);
+    }
+  }
+
+  undoTrail(solver, trail, mark);
+}
+
+// Capture the solver's state as a sample of the nodes searched so far
+void captureState() {
+  int sample;
+
+  if (numCaptured < numStates) {
+    copySolver(states[numCaptured++], solver);
+    return;
+  }
+
+  sample = rand_r(&seed) % nodeCount;
+  if (sample < numStates)
+    copySolver(states[sample], solver);
+}
+
+// Time updateConstraint for each type of constraint, assigning each value
+// each unassigned cell can take and unassigning it again, as applyNextValue
+// and unassignCell do
+void timeUpdateConstraint(kenken_solver_t* state) {
+  int cellIndex, i, r, value;
+  domain_t possibles, remaining;
+  constraint_t* constraint;
+  struct timespec startTime, endTime;
+  kenken_solver_t* s = work;
+
+  copySolver(s, state);
+  for (cellIndex = 0; cellIndex < s->totalNumCells; cellIndex++) {
+    possibles = getPossibles(s, cellIndex);
+    if (s->cells->values[cellIndex] != UNASSIGNED_VALUE || !possibles)
+      continue;
+
+    removeFromConstraints(s, cellIndex);
+    for (i = 0; i < NUM_CELL_CONSTRAINTS; i++) {
+      constraint = &(s->constraints[s->cells->constraintIndexes[i][cellIndex]]);
+
+      clock_gettime(CLOCK_MONOTONIC, &startTime);
+      for (r = 0; r < repeats; r++) {
+        for (remaining = possibles; remaining; remaining &= remaining - 1) {
+          value = LOWEST_VALUE(remaining);
+          updateConstraint(s, constraint, cellIndex, UNASSIGNED_VALUE, value);
+          updateConstraint(s, constraint, cellIndex, value, UNASSIGNED_VALUE);
+        }
+      }
+      clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+      numOps[s->N][constraint->type] += 2LL * repeats * POPCOUNT(possibles);
+      nanosecs[s->N][constraint->type] += NANO_DIFF(endTime, startTime);
+    }
+    addToConstraints(s, cellIndex);
+  }
+}
+
+// Time notifying the cells of each line of a value, and of all values, no
+// longer being possible and then possible again. Only values possible in
+// every cell of the line are used, so the line is left unchanged.
+void timeNotifyCells(kenken_solver_t* state) {
+  int i, k, r;
+  domain_t changes, remaining;
+  constraint_t* constraint;
+  int* listCells;
+  struct timespec startTime, endTime;
+  kenken_solver_t* s = work;
+
+  copySolver(s, state);
+  for (i = 0; i < NUM_CELL_LINES * s->N; i++) {
+    constraint = &(s->constraints[i]);
+    listCells = &(s->cells->listCells[constraint->cellList.offset]);
+    changes = RANGE_MASK(1, s->N);
+    for (k = 0; k < constraint->cellList.size; k++)
+      changes &= s->cells->masks[constraint->maskIndex][listCells[k]];
+    if (!changes)
+      continue;
+
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    for (r = 0; r < repeats; r++) {
+      for (remaining = changes; remaining; remaining &= remaining - 1) {
+        notifyCellsOfChange(s, constraint, LOWEST_VALUE(remaining), 0);
+        notifyCellsOfChange(s, constraint, LOWEST_VALUE(remaining), 1);
+      }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+    numOps[s->N][NOTIFY_CHANGE_KERNEL] += 2LL * repeats * POPCOUNT(changes);
+    nanosecs[s->N][NOTIFY_CHANGE_KERNEL] += NANO_DIFF(endTime, startTime);
+
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    for (r = 0; r < repeats; r++) {
+      notifyCellsOfChanges(s, constraint, changes, 0);
+      notifyCellsOfChanges(s, constraint, changes, 1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+    numOps[s->N][NOTIFY_CHANGES_KERNEL] += 2LL * repeats;
+    nanosecs[s->N][NOTIFY_CHANGES_KERNEL] += NANO_DIFF(endTime, startTime);
+  }
+}
+
+// Time choosing the next cell to fill. Each operation includes adding the
+// chosen cell back to its constraints, so the state is unchanged.
+void timeNextCell(kenken_solver_t* state) {
+  int r, cellIndex = 0;
+  struct timespec startTime, endTime;
+  kenken_solver_t* s = work;
+
+  copySolver(s, state);
+  clock_gettime(CLOCK_MONOTONIC, &startTime);
+  for (r = 0; r < repeats && cellIndex >= 0; r++) {
+    cellIndex = getNextCellToFillN(s, INT_MAX);
+    if (cellIndex >= 0)
+      addToConstraints(s, cellIndex);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+  // States with a cell without possibles fail without choosing a cell
+  if (cellIndex < 0)
+    return;
+
+  numOps[s->N][NEXT_CELL_KERNEL] += repeats;
+  nanosecs[s->N][NEXT_CELL_KERNEL] += NANO_DIFF(endTime, startTime);
+}
+
+// Time trying each value of the next cell to fill, as the search does. Each
+// pass over the values ends with the cell unassigned and added back to its
+// constraints, and includes removing it again for the next pass.
+void timeNextValue(kenken_solver_t* state) {
+  int r, cellIndex, value;
+  long long ops = 0;
+  struct timespec startTime, endTime;
+  kenken_solver_t* s = work;
+
+  copySolver(s, state);
+  if ((cellIndex = getNextCellToFill(s)) < 0)
+    return;
+
+  clock_gettime(CLOCK_MONOTONIC, &startTime);
+  for (r = 0; r < repeats; r++) {
+    value = UNASSIGNED_VALUE;
+    do {
+      value = applyNextValue(s, cellIndex, value);
+      ops++;
+    } while (value != UNASSIGNED_VALUE);
+    removeFromConstraints(s, cellIndex);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+  numOps[s->N][NEXT_VALUE_KERNEL] += ops;
+  nanosecs[s->N][NEXT_VALUE_KERNEL] += NANO_DIFF(endTime, startTime);
+}
+
+// Time removing each cell from each constraint's cell list and adding it back
+void timeListNodes(kenken_solver_t* state) {
+  int i, k, r, size;
+  int nodes[MAX_PROBLEM_SIZE * MAX_PROBLEM_SIZE];
+  constraint_t* constraint;
+  struct timespec startTime, endTime;
+  kenken_solver_t* s = work;
+
+  copySolver(s, state);
+  for (i = 0; i < s->numConstraints; i++) {
+    constraint = &(s->constraints[i]);
+    size = constraint->cellList.size;
+    if (size == 0)
+      continue;
+
+    // Removing cells reorders the list, so remove them in their original order
+    memcpy(nodes, &(s->cells->listCells[constraint->cellList.offset]),
+           sizeof(int) * size);
+
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    for (r = 0; r < repeats; r++) {
+      for (k = 0; k < size; k++) {
+        removeNode(s, constraint, nodes[k]);
+        addNode(s, constraint, nodes[k]);
+      }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+    numOps[s->N][LIST_NODE_KERNEL] += 2LL * repeats * size;
+    nanosecs[s->N][LIST_NODE_KERNEL] += NANO_DIFF(endTime, startTime);
+  }
+}
+
+// Print the nanoseconds per operation and operations per second of each
+// kernel for each board size, skipping kernels with no operations
+void printResults() {
+  int n, k;
+
+  printf("Size,Puzzles,States,Kernel,Operations,ns/op,ops/sec\n");
+  for (n = 1; n <= MAX_PROBLEM_SIZE; n++) {
+    for (k = 0; k < NUM_KERNELS; k++) {
+      if (numOps[n][k] == 0 || nanosecs[n][k] <= 0)
+        continue;
+
+      printf("%d,%d,%d,%s,%lld,%.2f,%.0f\n", n, numPuzzles[n],
+             numSizeStates[n], kernelNames[k], numOps[n][k],
+             nanosecs[n][k] / numOps[n][k],
+             numOps[n][k] * 1000000000.0 / nanosecs[n][k]);
+    }
+  }
+}
+
+// Print usage information and exit
+void usage(char* program) {
+  printf("Usage: %s [--states S] [--nodes M] [--repeats R] [search options] "
+         "filename...\n", program);
+  printf(SEARCH_OPTIONS_USAGE);
+  exit(0);
+}
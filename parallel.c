@@ -14,70 +14,248 @@
 
 // Length of processor job queue
 #define QUEUE_LENGTH 20
-// Increment in the job array
-#define INCREMENT(i) (((i) + 1) % (QUEUE_LENGTH))
-// Number of available slots in queue
-#define AVAILABLE(q) ((QUEUE_LENGTH - 1 - ((QUEUE_LENGTH + (q)->tail - \
-                      (q)->head) % QUEUE_LENGTH)))
+// Number of available slots in queue. Only exact for the queue's owner, since
+// thieves may steal jobs at any time.
+#define AVAILABLE(q) (QUEUE_LENGTH - (int)((q)->bottom - (q)->top))
+// Size of a cache line, used to keep queue indexes on separate lines
+#define CACHE_LINE_SIZE 64
+// Range of time an idle processor sleeps between rounds of failed steals
+#define MIN_BACKOFF_USECS 1
+#define MAX_BACKOFF_USECS 1024
 // Maximum length of a job that can be added to a queue
-#define MAX_JOB_LENGTH (5 * N)
-// Whether or not a job should be added to a queue
-#define ADD_TO_QUEUE(q, j) ((j)->length < MAX_JOB_LENGTH && AVAILABLE(q) >= N)
+#define MAX_JOB_LENGTH (5 * solver->N)
+// Whether or not a job should be added to a queue. Jobs with every cell
+// assigned are always solved, so the solution is found.
+#define ADD_TO_QUEUE(q, j) ((j)->length < MAX_JOB_LENGTH && \
+                            (j)->length < solver->totalNumCells && \
+                            AVAILABLE(q) >= solver->N)
+
+// Number of nodes a portfolio solver searches between restarts, scaled by
+// the Luby sequence
+#define RESTART_NODES 64
+// Number of cell orders portfolio solvers rotate through
+#define NUM_PORTFOLIO_ORDERS 3
+
+// Number of jobs per processor the deterministic mode splits the search into
+#define JOBS_PER_PROCESSOR 32
+// Most solutions any mode stops after
+#define MAX_STOP_SOLUTIONS 2
+
+// Current time in seconds if keeping stats, and add the seconds since start to
+// a time in the stats
+#define STATS_TIME(stats) ((stats) ? omp_get_wtime() : 0.0)
+#define ADD_STATS_TIME(stats, time, start) \
+  ((stats) ? (void)((stats)->time += omp_get_wtime() - (start)) : (void)0)
+
+// Number of events kept in each processor's trace, after which the oldest
+// events are overwritten
+#define TRACE_BUFFER_EVENTS 65536
+
+// Current time in seconds if tracing
+#define TRACE_TIME(trace) ((trace) ? omp_get_wtime() : 0.0)
 
 // Calculate number of milliseconds between two timevals
 #define TIME_DIFF(b, a) (((b).tv_sec - (a).tv_sec) * 1000.0 + \
                          ((b).tv_usec - (a).tv_usec) / 1000.0)
 
-typedef struct assignment {
-  int cellIndex;
-  int value;
-} assignment_t;
-
-typedef struct job {
-  int length;
-  assignment_t assignments[MAX_PROBLEM_SIZE * MAX_PROBLEM_SIZE];
-} job_t;
-
-// Job queue implemented as a circular array. Jobs are popped from head, and
-// pushed to tail.
+// Chase-Lev work-stealing deque implemented as a circular array indexed by
+// ever increasing top and bottom. The owner pushes and pops jobs at the
+// bottom without locking, and other processors steal jobs from the top. The
+// top and bottom are on separate cache lines, since thieves only write top.
 typedef struct job_queue {
+  long top;
+  char topPadding[CACHE_LINE_SIZE - sizeof(long)];
+  long bottom;
+  char bottomPadding[CACHE_LINE_SIZE - sizeof(long)];
+  // Number of jobs written below the bottom that thieves can not see yet
+  int numStaged;
   job_t queue[QUEUE_LENGTH];
-  volatile int head;
-  volatile int tail;
-  omp_lock_t headLock;
 } job_queue_t;
 
+// Result of a job searched in deterministic mode, held until the jobs before
+// it are committed
+typedef struct job_result {
+  // Whether the job's search finished or stopped
+  int done;
+  long long nodeCount;
+  long long numSolutions;
+  // Nodes visited when each of the first solutions was found, so the job can
+  // be committed up to any of them
+  long long solutionNodeCounts[MAX_STOP_SOLUTIONS];
+  // Solutions written by the job's search
+  char* output;
+} job_result_t;
+
+// Counters of a processor's work, kept with --stats. Each processor's
+// counters are on their own cache lines, since it updates them while
+// searching.
+typedef struct thread_stats {
+  solverstats_t solverStats;
+  long long nodeCount;
+  // Jobs searched or split, and jobs split in addToQueue and the jobs they
+  // added to the queue
+  long long jobsExecuted;
+  long long jobsSplit;
+  long long jobsAdded;
+  long long stealAttempts;
+  long long steals;
+  // Number of assignments applied to start jobs from the previous job's state
+  long long replayLength;
+  // Seconds spent searching and copying or replaying state, out of the total
+  // seconds the processor ran. The rest is spent idle, waiting for jobs.
+  double searchTime;
+  double copyTime;
+  double totalTime;
+} __attribute__((aligned(CACHE_LINE_SIZE))) thread_stats_t;
+
+// Performance counters of a processor, kept with --perf-counters, and the
+// nodes it visited while they counted
+typedef struct thread_perf {
+  perfcounters_t counters;
+  long long nodeCount;
+} thread_perf_t;
+
+// Types of events in a processor's trace
+typedef enum {
+  // Searching a job, or splitting it in addToQueue (length is the job's
+  // length, count is the jobs added), or a portfolio run (count is the run)
+  JOB_EVENT,
+  SPLIT_EVENT,
+  RUN_EVENT,
+  // Waiting for a job to steal (count is the rounds of steals that failed)
+  IDLE_EVENT,
+  // Stealing a job from another processor (count is the processor)
+  STEAL_EVENT
+} tracetype_t;
+
+typedef struct trace_event {
+  tracetype_t type;
+  int length;
+  int count;
+  // Seconds the event started and ended at
+  double start;
+  double end;
+} trace_event_t;
+
+// Ring buffer of a processor's most recent events, kept with --trace
+typedef struct trace_buffer {
+  // Number of events recorded, including those overwritten
+  long long numEvents;
+  trace_event_t events[TRACE_BUFFER_EVENTS];
+} trace_buffer_t;
+
 // Algorithm functions
 void runParallel(unsigned P);
-int getNextJob(int pid, job_t* myJob);
-int addToQueue(int step, cell_t* myCells, constraint_t* myConstraints,
-               job_queue_t* myJobQueue, assignment_t* assignments,
-               int availableSpots);
-int solve(int step, cell_t* myCells, constraint_t* myConstraints,
-          long long* myNodeCount);
+int getNextJob(int pid, job_t* myJob, unsigned int* mySeed,
+               thread_stats_t* myStats, trace_buffer_t* myTrace);
+void stageJob(job_queue_t* jobQueue, assignment_t* assignments, int length);
+void pushStagedJobs(job_queue_t* jobQueue);
+int popJob(job_queue_t* jobQueue, job_t* myJob);
+int stealJob(job_queue_t* jobQueue, job_t* myJob);
+int addToQueue(int step, kenken_solver_t* mySolver, job_queue_t* myJobQueue,
+               assignment_t* assignments, int availableSpots);
+void runPortfolio(int member, kenken_solver_t* mySolver, trail_t* myTrail,
+                  long long* myNodeCount, long long* mySolutionCount,
+                  writer_t* myWriter, thread_stats_t* myStats,
+                  trace_buffer_t* myTrace);
+long long luby(long long i);
+void prepareJobs(kenken_solver_t* mySolver, trail_t* myTrail);
+void searchJob(long index, kenken_solver_t* mySolver, trail_t* myTrail,
+               long long* myNodeCount, thread_stats_t* myStats,
+               trace_buffer_t* myTrace);
+void commitJobs(long index);
+int solve(int step, kenken_solver_t* mySolver, trail_t* myTrail,
+          long long* myNodeCount, long long myNodeLimit,
+          long long* mySolutionCount, writer_t* myWriter,
+          cellset_t* conflict, job_result_t* myResult);
+int isSearchStopped(search_t* search, int step);
+long long countSharedSolution(search_t* search);
+void writeStats(char* file);
+void writeThreadStats(FILE* out, thread_stats_t* stats, const char* indent);
+void printThreadPerf();
+void traceEvent(trace_buffer_t* trace, tracetype_t type, double start,
+                int length, int count);
+void writeTrace(char* file);
 void usage(char* program);
 
 
 // Number of processors
 unsigned P;
-// Problem grid
-cell_t* cells;
-// Constraints array
-constraint_t* constraints;
+// Number of processors running portfolio solvers instead of splitting jobs,
+// which are the last processors
+unsigned numPortfolio;
+// Number of processors splitting jobs, which are the first processors
+unsigned numSplitting;
+// Cell orders portfolio solvers rotate through
+cellorder_t portfolioOrders[NUM_PORTFOLIO_ORDERS] = {
+  MIN_POSSIBLES_ORDER, CAGE_ORDER, DOM_WDEG_ORDER
+};
+// Whether to split the search into jobs searched in any order, but committed
+// in the serial search order, so the results do not depend on timing
+int deterministic;
+// Jobs of the deterministic mode in the serial search order, and the results
+// of the jobs searched
+job_t* jobs;
+job_result_t* jobResults;
+long numJobs;
+// Next job of the deterministic mode to search, and to commit
+long nextJob;
+long nextCommit;
+// Last job of the deterministic mode whose results are needed, since enough
+// solutions were found by it and the jobs before it
+volatile long lastNeededJob;
+// Number of solutions after which the search stops
+long long solutionLimit;
+// Solver state at the root, which each processor clones
+kenken_solver_t* solver;
 // Array of job queues, so each processor owns a queue
 job_queue_t* jobQueues;
-// Flag to mark if a solution is found by a processor
+// Which solutions to search for
+solvemode_t mode;
+// Search options for the solver
+searchoptions_t options;
+// Flag to mark if enough solutions are found by the processors to stop, or
+// the whole search space has been searched by a portfolio solver or by the
+// processors splitting jobs
 volatile int found;
+// Number of solutions found by all processors, only kept up to date while
+// searching if the search stops early
+long long sharedSolutionCount;
+// Number of solutions found
+long long numSolutions;
+// Number of jobs queued or being worked on. The search is over when this
+// reaches 0, since only a job being worked on can add new jobs.
+long outstandingJobs;
 // Number of nodes visited
 long long nodeCount;
+// Number of failed-state cache hits and misses
+long long cacheHits, cacheMisses;
 // Program execution timinges (in milliseconds)
 double totalTime, compTime;
+// Counters of each processor's work, or NULL if --stats is not given
+thread_stats_t* threadStats;
+// Performance counters of each processor, or NULL if --perf-counters is not
+// given
+thread_perf_t* threadPerf;
+// Trace of each processor's events, or NULL if --trace is not given, and the
+// time the traces start at
+trace_buffer_t* traceBuffers;
+double traceStartTime;
+// Names of the types of trace events, and of their counts (NULL if unused)
+char* traceEventNames[] = {"job", "split", "run", "idle", "steal"};
+char* traceCountNames[] = {NULL, "jobsAdded", "run", "failedRounds", "victim"};
 
 int main(int argc, char **argv) {
-  int i;
+  long i;
   struct timeval startTime, endTime;
+  char* portfolio = removeOptionValue(&argc, argv, "--portfolio");
+  char* statsFile = removeOptionValue(&argc, argv, "--stats");
+  char* traceFile = removeOptionValue(&argc, argv, "--trace");
+  int usePerfCounters = removeOption(&argc, argv, "--perf-counters");
+  deterministic = removeOption(&argc, argv, "--deterministic");
 
-  if (argc != 3)
+  if (!getSearchOptions(&argc, argv, &options) ||
+      (int)(mode = getSolveMode(&argc, argv)) < 0 || argc != 3)
     usage(argv[0]);
 
   // Record start of total time
@@ -85,94 +263,290 @@ int main(int argc, char **argv) {
 
   // Initialize global variables and data-structures.
   P = atoi(argv[1]);
-  initialize(argv[2], &cells, &constraints);
+  numPortfolio = portfolio ? atoi(portfolio) : 0;
+  if ((int)P < 1 || (int)numPortfolio < 0 || numPortfolio > P)
+    usage(argv[0]);
+
+  // Portfolio solvers restart, so would find solutions more than once
+  if (numPortfolio > 0 && mode != FIRST_SOLUTION)
+    appError("Portfolio solvers only search for the first solution");
+
+  // Portfolio solvers race, and the cache is filled in any order
+  if (deterministic && (numPortfolio > 0 || options.cacheSize > 0))
+    appError("Deterministic mode can not use portfolio solvers or the cache");
+
+  numSplitting = P - numPortfolio;
+  solver = createSolver(argv[2]);
+  setSearchOptions(solver, &options);
   nodeCount = 0;
+  cacheHits = 0;
+  cacheMisses = 0;
+  numSolutions = 0;
+  sharedSolutionCount = 0;
   found = 0;
+  solutionLimit = (mode == FIRST_SOLUTION) ? 1 :
+                  (mode == UNIQUE_SOLUTION) ? MAX_STOP_SOLUTIONS : LLONG_MAX;
 
-  jobQueues = (job_queue_t*)calloc(sizeof(job_queue_t), P);
-  if (!jobQueues)
-    unixError("Failed to allocated memory for the job queues");
+  if (posix_memalign((void**)&jobQueues, CACHE_LINE_SIZE,
+                     sizeof(job_queue_t) * P))
+    appError("Failed to allocated memory for the job queues");
+  memset(jobQueues, 0, sizeof(job_queue_t) * P);
 
-  for (i = 0; i < P; i++)
-    omp_init_lock(&(jobQueues[i].headLock));
+  threadStats = NULL;
+  if (statsFile) {
+    if (posix_memalign((void**)&threadStats, CACHE_LINE_SIZE,
+                       sizeof(thread_stats_t) * P))
+      appError("Failed to allocate memory for the stats");
+    memset(threadStats, 0, sizeof(thread_stats_t) * P);
+  }
+
+  threadPerf = NULL;
+  if (usePerfCounters) {
+    threadPerf = (thread_perf_t*)malloc(sizeof(thread_perf_t) * P);
+    if (!threadPerf)
+      unixError("Failed to allocate memory for the performance counters");
+  }
+
+  traceBuffers = NULL;
+  if (traceFile) {
+    traceBuffers = (trace_buffer_t*)malloc(sizeof(trace_buffer_t) * P);
+    if (!traceBuffers)
+      unixError("Failed to allocate memory for the traces");
+    for (i = 0; i < P; i++)
+      traceBuffers[i].numEvents = 0;
+    traceStartTime = omp_get_wtime();
+  }
 
   // Add initial job (nothing assigned) to root processor
-  jobQueues[0].tail = 1;
+  jobQueues[0].bottom = 1;
+  outstandingJobs = 1;
 
 
   runParallel(P);
-  if (!found)
-    appError("No solution found");
 
   // Use final time to calculate total time
   gettimeofday(&endTime, NULL);
   totalTime = TIME_DIFF(endTime, startTime);
 
-  // Print out number of nodes visited and calculated times
+  // Print out number of solutions and nodes visited, and calculated times
+  printSolutionCount(stdout, mode, numSolutions);
   printf("Nodes Visited: %lld\n", nodeCount);
+  printCacheCounts(stdout, &options, cacheHits, cacheMisses);
   printf("Computation Time = %.3f millisecs\n", compTime);
   printf("      Total Time = %.3f millisecs\n", totalTime);
+  if (threadPerf)
+    printThreadPerf();
+  if (statsFile)
+    writeStats(statsFile);
+  if (traceFile)
+    writeTrace(traceFile);
 
+  free(jobQueues);
+  free(threadStats);
+  free(threadPerf);
+  free(traceBuffers);
+  if (deterministic) {
+    for (i = 0; i < numJobs; i++)
+      free(jobResults[i].output);
+    free(jobResults);
+    free(jobs);
+  }
+  freeSolver(solver);
+
+  // Fail after the nodes visited are printed, so they can still be merged
+  if (mode == FIRST_SOLUTION && numSolutions == 0)
+    appError("No solution found");
   return 0;
 }
 
 // Sets up and runs the parallel kenken solver
 void runParallel(unsigned P) {
-  int i, pid;
-  long long myNodeCount;
-  job_t* myJob;
-  cell_t* myCells;
-  constraint_t* myConstraints;
+  int i, pid, commonLength;
+  long myJobIndex;
+  unsigned int mySeed;
+  int* myTrailMarks;
+  long long myNodeCount, mySolutionCount;
+  double myStartTime, myTime, myJobTime;
+  job_t* myJob, *myPreviousJob, *tmpJob;
+  kenken_solver_t* mySolver;
+  trail_t* myTrail;
+  writer_t* myWriter;
+  cellset_t myConflict;
+  thread_stats_t* myStats;
+  trace_buffer_t* myTrace;
+  thread_perf_t* myPerf;
   struct timeval startCompTime, endCompTime;
 
   // Begin parallel
   omp_set_num_threads(P);
 
   // Run algorithm
-#pragma omp parallel default(shared) private(i, pid, myNodeCount, myJob, \
-                                             myCells, myConstraints)
+#pragma omp parallel default(shared) private(i, pid, commonLength, myJobIndex, \
+                                             mySeed, myTrailMarks, myNodeCount, \
+                                             mySolutionCount, myJob, \
+                                             myPreviousJob, tmpJob, mySolver, \
+                                             myTrail, myWriter, myConflict, \
+                                             myStats, myStartTime, myTime, \
+                                             myJobTime, myTrace, myPerf)
 {
   // Initialize local variables and data-structures
   pid = omp_get_thread_num();
+  mySeed = pid + 1;
   myNodeCount = 0;
+  mySolutionCount = 0;
+  myStats = threadStats ? &(threadStats[pid]) : NULL;
+  myTrace = traceBuffers ? &(traceBuffers[pid]) : NULL;
+  myPerf = threadPerf ? &(threadPerf[pid]) : NULL;
 
-  myConstraints = (constraint_t*)calloc(sizeof(constraint_t), numConstraints);
-  if (!myConstraints)
-    unixError("Failed to allocate memory for myConstraints");
+  // Start from the root, which is the state of an empty previous job
+  mySolver = cloneSolver(solver);
+  if (myStats)
+    mySolver->stats = &(myStats->solverStats);
+  if (myPerf)
+    openPerfCounters(&(myPerf->counters));
+  myTrail = allocateTrail();
+  myWriter = allocateWriter(stdout);
 
-  myCells = (cell_t*)calloc(sizeof(cell_t), totalNumCells);
-  if (!myCells)
-    unixError("Failed to allocate memory for myCells");
+  myTrailMarks = (int*)malloc(sizeof(int) * solver->totalNumCells);
+  if (!myTrailMarks)
+    unixError("Failed to allocate memory for myTrailMarks");
 
   myJob = (job_t*)malloc(sizeof(job_t));
-  if (!myJob)
+  myPreviousJob = (job_t*)malloc(sizeof(job_t));
+  if (!myJob || !myPreviousJob)
     unixError("Failed to allocate memory for myJob");
 
+  myPreviousJob->length = 0;
+
   // Record start of computation time
   #pragma omp single
     gettimeofday(&startCompTime, NULL);
+  myStartTime = STATS_TIME(myStats);
+  if (myPerf)
+    startPerfCounters(&(myPerf->counters));
 
-  // Get and complete new job until none left, or solution found
-  while (getNextJob(pid, myJob)) {
-    memcpy(myConstraints, constraints, numConstraints * sizeof(constraint_t));
-    memcpy(myCells, cells, totalNumCells * sizeof(cell_t));
+  // The deterministic mode's jobs are split by one processor while the others
+  // wait, then started in order, so every job needed is searched
+  if (deterministic) {
+    #pragma omp single
+    {
+      myTime = STATS_TIME(myStats);
+      myJobTime = TRACE_TIME(myTrace);
+      prepareJobs(mySolver, myTrail);
+      ADD_STATS_TIME(myStats, searchTime, myTime);
+      myNodeCount += nodeCount;
+      if (myTrace)
+        traceEvent(myTrace, SPLIT_EVENT, myJobTime, 0, numJobs);
+    }
+
+    while ((myJobIndex = __atomic_fetch_add(&nextJob, 1, __ATOMIC_RELAXED)) <
+           numJobs && myJobIndex <= lastNeededJob)
+      searchJob(myJobIndex, mySolver, myTrail, &myNodeCount, myStats,
+                myTrace);
+  }
+  else if (pid >= numSplitting)
+    runPortfolio(pid - numSplitting, mySolver, myTrail, &myNodeCount,
+                 &mySolutionCount, myWriter, myStats, myTrace);
 
-    for (i = 0; i < myJob->length; i++)
-      applyValue(myCells, myConstraints, myJob->assignments[i].cellIndex,
+  // Get and complete new job until none left, or enough solutions found
+  while (!deterministic && pid < numSplitting &&
+         getNextJob(pid, myJob, &mySeed, myStats, myTrace)) {
+    myTime = STATS_TIME(myStats);
+    myJobTime = TRACE_TIME(myTrace);
+
+    // Searching a job leaves the cells as they were after applying the job's
+    // assignments, so only undo the assignments not shared with the previous
+    // job, and apply the rest
+    for (commonLength = 0; commonLength < myJob->length &&
+         commonLength < myPreviousJob->length; commonLength++) {
+      if (myJob->assignments[commonLength].cellIndex !=
+          myPreviousJob->assignments[commonLength].cellIndex ||
+          myJob->assignments[commonLength].value !=
+          myPreviousJob->assignments[commonLength].value)
+        break;
+    }
+
+    if (commonLength < myPreviousJob->length)
+      undoTrail(mySolver, myTrail, myTrailMarks[commonLength]);
+
+    mySolver->trail = myTrail;
+    for (i = commonLength; i < myJob->length; i++) {
+      myTrailMarks[i] = myTrail->size;
+      applyValue(mySolver, myJob->assignments[i].cellIndex,
                  myJob->assignments[i].value);
+    }
+    mySolver->trail = NULL;
+
+    ADD_STATS_TIME(myStats, copyTime, myTime);
+    myTime = STATS_TIME(myStats);
+    if (myStats) {
+      myStats->jobsExecuted++;
+      myStats->replayLength += myJob->length - commonLength;
+    }
 
     if (ADD_TO_QUEUE(&(jobQueues[pid]), myJob)) {
       myNodeCount++;
       // Guarenteed to succeed given ADD_TO_QUEUE(...) returned true
-      addToQueue(myJob->length, myCells, myConstraints, &(jobQueues[pid]),
+      addToQueue(myJob->length, mySolver, &(jobQueues[pid]),
                  myJob->assignments, AVAILABLE(&jobQueues[pid]));
+      if (myStats) {
+        myStats->jobsSplit++;
+        myStats->jobsAdded += jobQueues[pid].numStaged;
+      }
+      if (myTrace)
+        traceEvent(myTrace, SPLIT_EVENT, myJobTime, myJob->length,
+                   jobQueues[pid].numStaged);
+      pushStagedJobs(&(jobQueues[pid]));
+    }
+    else {
+      // The job's cells were changed without being propagated
+      queueAllLines(mySolver);
+      solve(myJob->length, mySolver, myTrail, &myNodeCount, LLONG_MAX,
+            &mySolutionCount, myWriter, &myConflict, NULL);
+      if (myTrace)
+        traceEvent(myTrace, JOB_EVENT, myJobTime, myJob->length, 0);
     }
-    else
-      solve(myJob->length, myCells, myConstraints, &myNodeCount);
+    ADD_STATS_TIME(myStats, searchTime, myTime);
+
+    // Finished job, after any jobs it added were counted. Once no jobs are
+    // left, the portfolio solvers have nothing more to find.
+    if (__atomic_sub_fetch(&outstandingJobs, 1, __ATOMIC_ACQ_REL) == 0 &&
+        numPortfolio > 0)
+      found = 1;
+
+    tmpJob = myPreviousJob;
+    myPreviousJob = myJob;
+    myJob = tmpJob;
   }
 
+  if (myPerf) {
+    stopPerfCounters(&(myPerf->counters));
+    closePerfCounters(&(myPerf->counters));
+    myPerf->nodeCount = myNodeCount;
+  }
+
+  // The deterministic mode counts the nodes of its jobs as they are committed,
+  // so only counts the processor's nodes for its own counters
   #pragma omp critical
-    nodeCount += myNodeCount;
+  {
+    if (!deterministic)
+      nodeCount += myNodeCount;
+    numSolutions += mySolutionCount;
+    cacheHits += mySolver->cacheHits;
+    cacheMisses += mySolver->cacheMisses;
+  }
+
+  if (myStats) {
+    myStats->nodeCount += myNodeCount;
+    myStats->totalTime = omp_get_wtime() - myStartTime;
+  }
+
+  freeWriter(myWriter);
+  freeTrail(myTrail);
+  freeSolver(mySolver);
+  free(myTrailMarks);
+  free(myJob);
+  free(myPreviousJob);
 }
 
   // Calculate computation time
@@ -180,50 +554,151 @@ void runParallel(unsigned P) {
   compTime = TIME_DIFF(endCompTime, startCompTime);
 }
 
-// Retrieves the next job from the job array. Will block until a job is
-// available. Note, if the puzzle has no solution, then this will block forever.
-// Since only care about puzzles with solutions, this is fine (no need to add
-// logic for a case that will never happen by assumption).
-int getNextJob(int pid, job_t* myJob) {
-  int i;
-  job_t* nextJob;
+// Retrieves the next job, popping from the processor's own queue first and
+// otherwise stealing from randomly chosen queues. Will block until a job is
+// available, sleeping for longer and longer between rounds of failed steals.
+// Returns 0 once a solution is found, or no jobs are left.
+int getNextJob(int pid, job_t* myJob, unsigned int* mySeed,
+               thread_stats_t* myStats, trace_buffer_t* myTrace) {
+  int i, victim, numRounds = 0;
+  int backoff = MIN_BACKOFF_USECS;
+  double idleTime;
 
-  for (i = pid; !found; i = (i + 1) % P) {
-    if (jobQueues[i].head == jobQueues[i].tail)
-      continue;
+  // Searches stop early once a solution is found, leaving the cells in the
+  // middle of a search, so no more jobs can be started
+  if (found)
+    return 0;
 
-    omp_set_lock(&(jobQueues[i].headLock));
-    if (jobQueues[i].head != jobQueues[i].tail && !found) {
-      nextJob = &(jobQueues[i].queue[jobQueues[i].head]);
-      myJob->length = nextJob->length;
-      memcpy(myJob->assignments, nextJob->assignments,
-             sizeof(assignment_t) * nextJob->length);
+  if (popJob(&(jobQueues[pid]), myJob))
+    return 1;
 
-      jobQueues[i].head = INCREMENT(jobQueues[i].head);
-      omp_unset_lock(&(jobQueues[i].headLock));
-      return 1;
+  idleTime = TRACE_TIME(myTrace);
+  while (!found && __atomic_load_n(&outstandingJobs, __ATOMIC_ACQUIRE) > 0) {
+    for (i = 0; i < numSplitting; i++) {
+      if (myStats)
+        myStats->stealAttempts++;
+      victim = rand_r(mySeed) % numSplitting;
+      if (stealJob(&(jobQueues[victim]), myJob)) {
+        if (myStats)
+          myStats->steals++;
+        if (myTrace) {
+          traceEvent(myTrace, IDLE_EVENT, idleTime, 0, numRounds);
+          traceEvent(myTrace, STEAL_EVENT, omp_get_wtime(), myJob->length,
+                     victim);
+        }
+        return 1;
+      }
     }
 
-    omp_unset_lock(&(jobQueues[i].headLock));
+    usleep(backoff);
+    if (backoff < MAX_BACKOFF_USECS)
+      backoff *= 2;
+    numRounds++;
   }
 
+  if (myTrace)
+    traceEvent(myTrace, IDLE_EVENT, idleTime, 0, numRounds);
   return 0;
 }
 
+// Write a job below the bottom of the processor's own queue, without making it
+// visible to thieves. The queue must have an available slot.
+void stageJob(job_queue_t* jobQueue, assignment_t* assignments, int length) {
+  long bottom = __atomic_load_n(&(jobQueue->bottom), __ATOMIC_RELAXED);
+  job_t* job = &(jobQueue->queue[(bottom + jobQueue->numStaged) %
+                                 QUEUE_LENGTH]);
+
+  memcpy(&(job->assignments), assignments, length * sizeof(assignment_t));
+  job->length = length;
+  jobQueue->numStaged++;
+}
+
+// Push the staged jobs onto the bottom of the processor's own queue. The jobs
+// are reversed first, so the owner pops them in the order they were staged
+// (the serial search order) and thieves steal the last staged jobs.
+void pushStagedJobs(job_queue_t* jobQueue) {
+  int i, j;
+  job_t tmpJob;
+  long bottom = __atomic_load_n(&(jobQueue->bottom), __ATOMIC_RELAXED);
+
+  for (i = 0, j = jobQueue->numStaged - 1; i < j; i++, j--) {
+    copyJob(&tmpJob, &(jobQueue->queue[(bottom + i) % QUEUE_LENGTH]));
+    copyJob(&(jobQueue->queue[(bottom + i) % QUEUE_LENGTH]),
+            &(jobQueue->queue[(bottom + j) % QUEUE_LENGTH]));
+    copyJob(&(jobQueue->queue[(bottom + j) % QUEUE_LENGTH]), &tmpJob);
+  }
+
+  // Count the jobs before they can be stolen and finished
+  __atomic_add_fetch(&outstandingJobs, jobQueue->numStaged, __ATOMIC_RELAXED);
+
+  // Make the jobs visible before thieves can see the new bottom
+  __atomic_store_n(&(jobQueue->bottom), bottom + jobQueue->numStaged,
+                   __ATOMIC_RELEASE);
+  jobQueue->numStaged = 0;
+}
+
+// Pop a job from the bottom of the processor's own queue into myJob. Returns
+// whether a job was popped.
+int popJob(job_queue_t* jobQueue, job_t* myJob) {
+  int popped = 1;
+  long top;
+  long bottom = __atomic_load_n(&(jobQueue->bottom), __ATOMIC_RELAXED) - 1;
+
+  __atomic_store_n(&(jobQueue->bottom), bottom, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  top = __atomic_load_n(&(jobQueue->top), __ATOMIC_RELAXED);
+
+  // Queue was empty
+  if (top > bottom) {
+    __atomic_store_n(&(jobQueue->bottom), bottom + 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+
+  copyJob(myJob, &(jobQueue->queue[bottom % QUEUE_LENGTH]));
+
+  // Race thieves for the last job in the queue
+  if (top == bottom) {
+    popped = __atomic_compare_exchange_n(&(jobQueue->top), &top, top + 1, 0,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&(jobQueue->bottom), bottom + 1, __ATOMIC_RELAXED);
+  }
+
+  return popped;
+}
+
+// Steal a job from the top of another processor's queue into myJob. Returns
+// whether a job was stolen.
+int stealJob(job_queue_t* jobQueue, job_t* myJob) {
+  long top = __atomic_load_n(&(jobQueue->top), __ATOMIC_ACQUIRE);
+  long bottom;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  bottom = __atomic_load_n(&(jobQueue->bottom), __ATOMIC_ACQUIRE);
+
+  if (top >= bottom)
+    return 0;
+
+  // The job may be overwritten while copying it if the owner pops and pushes
+  // again, but then the top has moved and the steal fails
+  if (!copyJob(myJob, &(jobQueue->queue[top % QUEUE_LENGTH])))
+    return 0;
+
+  return __atomic_compare_exchange_n(&(jobQueue->top), &top, top + 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
 // Split up a job into smaller jobs and add each part to the given queue.
 // Returns the number of spots used, or -1 if failed to split up job.
-int addToQueue(int step, cell_t* myCells, constraint_t* myConstraints,
-               job_queue_t* myJobQueue, assignment_t* assignments,
-               int availableSpots) {
+int addToQueue(int step, kenken_solver_t* mySolver, job_queue_t* myJobQueue,
+               assignment_t* assignments, int availableSpots) {
   int cellIndex, spotsUsed;
   int value = UNASSIGNED_VALUE;
   int originalAvailableSpots = availableSpots;
-  job_t* job;
 
   if (step > MAX_JOB_LENGTH)
     return -1;
 
-  cellIndex = getNextCellToFillN(myCells, myConstraints, availableSpots);
+  cellIndex = getNextCellToFillN(mySolver, availableSpots);
   if (cellIndex == IMPOSSIBLE_STATE)
     return 0;
   else if (cellIndex == TOO_MANY_POSSIBLES)
@@ -231,14 +706,14 @@ int addToQueue(int step, cell_t* myCells, constraint_t* myConstraints,
 
   // Preemptively assign each possible a spot in the queue, so there is always
   // at least room in queue to add the job itself
-  availableSpots -= getNumPossibles(cells, cellIndex);
+  availableSpots -= getNumPossibles(mySolver, cellIndex);
 
   assignments[step].cellIndex = cellIndex;
-  while (UNASSIGNED_VALUE != (value = applyNextValue(myCells, myConstraints,
-                                                     cellIndex, value))) {
+  while (UNASSIGNED_VALUE != (value = applyNextValue(mySolver, cellIndex,
+                                                     value))) {
     assignments[step].value = value;
-    spotsUsed = addToQueue(step + 1, myCells, myConstraints, myJobQueue,
-                           assignments, availableSpots + 1);
+    spotsUsed = addToQueue(step + 1, mySolver, myJobQueue, assignments,
+                           availableSpots + 1);
 
     // Able to add split up job to queue, so just update available spot count
     if (spotsUsed >= 0) {
@@ -247,11 +722,7 @@ int addToQueue(int step, cell_t* myCells, constraint_t* myConstraints,
     }
 
     // Add job to queue since failed to add split up job to queue
-    job = &(myJobQueue->queue[myJobQueue->tail]);
-    memcpy(&(job->assignments), assignments, (step + 1) * sizeof(assignment_t));
-    job->length = step + 1;
-
-    myJobQueue->tail = INCREMENT(myJobQueue->tail);
+    stageJob(myJobQueue, assignments, step + 1);
   }
 
   // Return the number of spots in the queue that were used
@@ -259,46 +730,388 @@ int addToQueue(int step, cell_t* myCells, constraint_t* myConstraints,
   return (originalAvailableSpots - availableSpots);
 }
 
-// Main recursive function used to solve the program
-int solve(int step, cell_t* myCells, constraint_t* myConstraints,
-          long long* myNodeCount) {
-  int cellIndex;
-  int value = UNASSIGNED_VALUE;
+// Run a portfolio solver on the whole puzzle until a solution is found by any
+// processor, or the solver searches the whole puzzle. Each member after the
+// first uses its own cell order, and a random value order with its own seed.
+// Members restart from the root after the number of nodes given by the Luby
+// sequence, keeping the constraint weights learned by dom/wdeg. The first
+// member never restarts and keeps the search options, unless processors are
+// splitting jobs, which already search that way.
+void runPortfolio(int member, kenken_solver_t* mySolver, trail_t* myTrail,
+                  long long* myNodeCount, long long* mySolutionCount,
+                  writer_t* myWriter, thread_stats_t* myStats,
+                  trace_buffer_t* myTrace) {
+  int i, stopped;
+  long long run;
+  double time;
+  cellset_t conflict;
+  int restarts = (member > 0 || numSplitting > 0);
+  int* weights = (int*)malloc(sizeof(int) * solver->numConstraints);
+  if (!weights)
+    unixError("Failed to allocate memory for the constraint weights");
 
-  if (found)
-    return 1;
+  if (restarts) {
+    mySolver->cellOrder = portfolioOrders[member % NUM_PORTFOLIO_ORDERS];
+    mySolver->valueOrder = RANDOM_VALUE_ORDER;
+    mySolver->seed = member + 1;
+  }
 
-  if (step == totalNumCells) {
-    // Print out solution and set found to true
-    #pragma omp critical
-    {
-      if (!found) {
-        printSolution(myCells);
-        found = 1;
+  for (run = 1; !found; run++) {
+    queueAllLines(mySolver);
+    time = (myStats || myTrace) ? omp_get_wtime() : 0.0;
+    stopped = solve(0, mySolver, myTrail, myNodeCount,
+                    restarts ? *myNodeCount + luby(run) * RESTART_NODES :
+                    LLONG_MAX, mySolutionCount, myWriter, &conflict, NULL);
+    ADD_STATS_TIME(myStats, searchTime, time);
+    if (myTrace)
+      traceEvent(myTrace, RUN_EVENT, time, 0, run);
+
+    // Searched the whole puzzle, so no other processor can find more
+    if (!stopped) {
+      found = 1;
+      break;
+    }
+
+    // Stopping leaves the cells in the middle of a search, so restart from
+    // the root solver's state with the weights learned so far
+    time = STATS_TIME(myStats);
+    for (i = 0; i < solver->numConstraints; i++)
+      weights[i] = mySolver->constraints[i].weight;
+    copySolver(mySolver, solver);
+    for (i = 0; i < solver->numConstraints; i++)
+      mySolver->constraints[i].weight = weights[i];
+    myTrail->size = 0;
+    ADD_STATS_TIME(myStats, copyTime, time);
+  }
+
+  free(weights);
+}
+
+// Get the i-th number (starting from 1) of the Luby sequence:
+// 1 1 2 1 1 2 4 1 1 2 1 1 2 4 8 ...
+long long luby(long long i) {
+  int k;
+
+  for (;;) {
+    for (k = 1; (1LL << k) - 1 < i; k++);
+    if ((1LL << k) - 1 == i)
+      return 1LL << (k - 1);
+
+    i -= (1LL << (k - 1)) - 1;
+  }
+}
+
+// Split the search of the deterministic mode into at least JOBS_PER_PROCESSOR
+// jobs per processor in the serial search order, counting the nodes visited
+// splitting them, and start the jobs' results
+void prepareJobs(kenken_solver_t* mySolver, trail_t* myTrail) {
+  jobs = splitJobs(solver, mySolver, myTrail, JOBS_PER_PROCESSOR * P, &numJobs,
+                   &nodeCount);
+
+  jobResults = (job_result_t*)calloc(sizeof(job_result_t), numJobs);
+  if (!jobResults)
+    unixError("Failed to allocate memory for the job results");
+  nextJob = 0;
+  nextCommit = 0;
+  lastNeededJob = numJobs - 1;
+}
+
+// Search a job of the deterministic mode, writing its solutions to its own
+// output and adding its nodes to myNodeCount, then commit the jobs that are
+// ready
+void searchJob(long index, kenken_solver_t* mySolver, trail_t* myTrail,
+               long long* myNodeCount, thread_stats_t* myStats,
+               trace_buffer_t* myTrace) {
+  job_result_t* result = &(jobResults[index]);
+  long long jobNodeCount = 0, jobSolutionCount = 0;
+  double time, jobTime;
+  size_t outputSize;
+  FILE* out;
+  writer_t* writer;
+  cellset_t conflict;
+
+  if (!(out = open_memstream(&(result->output), &outputSize)))
+    unixError("Failed to open job output");
+  writer = allocateWriter(out);
+
+  jobTime = TRACE_TIME(myTrace);
+  time = STATS_TIME(myStats);
+  // The job starts from the root solver's state without any nogoods learned,
+  // so its search does not depend on what the processor searched before
+  loadJob(mySolver, solver, myTrail, &(jobs[index]));
+  clearNogoods(mySolver);
+  ADD_STATS_TIME(myStats, copyTime, time);
+
+  time = STATS_TIME(myStats);
+  solve(jobs[index].length, mySolver, myTrail, &jobNodeCount, LLONG_MAX,
+        &jobSolutionCount, writer, &conflict, result);
+  ADD_STATS_TIME(myStats, searchTime, time);
+  if (myTrace)
+    traceEvent(myTrace, JOB_EVENT, jobTime, jobs[index].length, 0);
+  if (myStats) {
+    myStats->jobsExecuted++;
+    myStats->replayLength += jobs[index].length;
+  }
+  *myNodeCount += jobNodeCount;
+
+  freeWriter(writer);
+  if (fclose(out))
+    unixError("Failed to write job output");
+
+  result->nodeCount = jobNodeCount;
+  result->numSolutions = jobSolutionCount;
+  commitJobs(index);
+}
+
+// Mark a job of the deterministic mode done, then commit every done job whose
+// jobs before it are committed, in the job order: count its nodes and
+// solutions, and print its solutions. The job reaching the solution limit is
+// only counted up to its last solution needed, and is the last job needed.
+void commitJobs(long index) {
+  job_result_t* result;
+  long long numNeeded;
+
+  #pragma omp critical(results)
+  {
+    jobResults[index].done = 1;
+    if (jobResults[index].numSolutions >= solutionLimit &&
+        index < lastNeededJob)
+      lastNeededJob = index;
+
+    while (nextCommit <= lastNeededJob && jobResults[nextCommit].done) {
+      result = &(jobResults[nextCommit]);
+
+      // Only the first solution is written unless writing all of them
+      if (mode == ALL_SOLUTIONS || numSolutions == 0)
+        fputs(result->output, stdout);
+
+      numNeeded = solutionLimit - numSolutions;
+      if (result->numSolutions >= numNeeded) {
+        nodeCount += result->solutionNodeCounts[numNeeded - 1];
+        numSolutions += numNeeded;
+        lastNeededJob = nextCommit;
       }
+      else {
+        nodeCount += result->nodeCount;
+        numSolutions += result->numSolutions;
+      }
+
+      free(result->output);
+      result->output = NULL;
+      nextCommit++;
     }
+  }
+}
 
-    return 1;
+// Search from a processor's solver state, where step cells are assigned.
+// Deductions made by propagation are recorded in myTrail. Returns whether the
+// search should stop, which it also does once myNodeCount reaches myNodeLimit.
+// When backjumping, conflict is set to the cells whose values caused the
+// search to fail. myResult is the result of the deterministic mode's job being
+// searched, or NULL in the other modes.
+int solve(int step, kenken_solver_t* mySolver, trail_t* myTrail,
+          long long* myNodeCount, long long myNodeLimit,
+          long long* mySolutionCount, writer_t* myWriter,
+          cellset_t* conflict, job_result_t* myResult) {
+  search_t search;
+
+  initSearch(&search, mySolver, myTrail, mode, myWriter, myNodeCount,
+             mySolutionCount);
+  search.nodeLimit = myNodeLimit;
+  search.stopNode = isSearchStopped;
+  search.countSolution = countSharedSolution;
+  search.data = myResult;
+  return searchNode(&search, step, conflict);
+}
+
+// Whether a processor's search should stop at its next node, because enough
+// solutions were found, or the deterministic mode's job being searched is no
+// longer needed
+int isSearchStopped(search_t* search, int step) {
+  job_result_t* myResult = (job_result_t*)search->data;
+
+  return found || (myResult && myResult - jobResults > lastNeededJob);
+}
+
+// Count a solution found by a processor's search. Searches that stop early
+// share a count of solutions, so only the first solution is written and every
+// processor knows when to stop, except in deterministic mode, where each job
+// counts its own solutions. Returns the count of solutions.
+long long countSharedSolution(search_t* search) {
+  job_result_t* myResult = (job_result_t*)search->data;
+  long long solutionCount = *(search->numSolutions);
+
+  if (myResult) {
+    if (solutionCount <= MAX_STOP_SOLUTIONS)
+      myResult->solutionNodeCounts[solutionCount - 1] = *(search->nodeCount);
+
+    // A deterministic job stops by itself, since the jobs before it are needed
+    return solutionCount;
   }
 
-  (*myNodeCount)++;
-  // Find the next cell to fill and test all possible values
-  if ((cellIndex = getNextCellToFill(myCells, myConstraints)) < 0)
-    return 0;
+  if (mode == FIRST_SOLUTION || mode == UNIQUE_SOLUTION) {
+    solutionCount = __atomic_add_fetch(&sharedSolutionCount, 1,
+                                       __ATOMIC_ACQ_REL);
+    if (STOP_SEARCH(mode, solutionCount))
+      found = 1;
+  }
+
+  return solutionCount;
+}
 
-  while (UNASSIGNED_VALUE != (value = applyNextValue(myCells, myConstraints,
-                                                     cellIndex, value))) {
-    if (solve(step + 1, myCells, myConstraints, myNodeCount))
-      return 1;
+// Write the processors' counters, and their totals, to a file as JSON. Times
+// are in milliseconds.
+void writeStats(char* file) {
+  unsigned i;
+  FILE* out;
+  thread_stats_t total;
+
+  memset(&total, 0, sizeof(thread_stats_t));
+  for (i = 0; i < P; i++) {
+    addSolverStats(&(total.solverStats), &(threadStats[i].solverStats));
+    total.nodeCount += threadStats[i].nodeCount;
+    total.jobsExecuted += threadStats[i].jobsExecuted;
+    total.jobsSplit += threadStats[i].jobsSplit;
+    total.jobsAdded += threadStats[i].jobsAdded;
+    total.stealAttempts += threadStats[i].stealAttempts;
+    total.steals += threadStats[i].steals;
+    total.replayLength += threadStats[i].replayLength;
+    total.searchTime += threadStats[i].searchTime;
+    total.copyTime += threadStats[i].copyTime;
+    total.totalTime += threadStats[i].totalTime;
   }
 
-  return 0;
+  if (!(out = fopen(file, "w")))
+    unixError("Failed to open stats file");
+
+  fprintf(out, "{\n  \"processors\": %u,\n  \"solutions\": %lld,\n"
+          "  \"nodes\": %lld,\n  \"computationTime\": %.3f,\n"
+          "  \"total\": {\n", P, numSolutions, nodeCount, compTime);
+  writeThreadStats(out, &total, "    ");
+  fprintf(out, "  },\n  \"threads\": [\n");
+  for (i = 0; i < P; i++) {
+    fprintf(out, "    {\n");
+    writeThreadStats(out, &(threadStats[i]), "      ");
+    fprintf(out, "    }%s\n", (i + 1 < P) ? "," : "");
+  }
+  fprintf(out, "  ]\n}\n");
+
+  if (fclose(out))
+    unixError("Failed to write stats file");
 }
 
+// Write a processor's counters as the members of a JSON object, with each line
+// starting with indent
+void writeThreadStats(FILE* out, thread_stats_t* stats, const char* indent) {
+  fprintf(out, "%s\"nodes\": %lld,\n", indent, stats->nodeCount);
+  fprintf(out, "%s\"jobsExecuted\": %lld,\n", indent, stats->jobsExecuted);
+  fprintf(out, "%s\"jobsSplit\": %lld,\n", indent, stats->jobsSplit);
+  fprintf(out, "%s\"jobsAdded\": %lld,\n", indent, stats->jobsAdded);
+  fprintf(out, "%s\"stealAttempts\": %lld,\n", indent, stats->stealAttempts);
+  fprintf(out, "%s\"steals\": %lld,\n", indent, stats->steals);
+  fprintf(out, "%s\"replayLength\": %lld,\n", indent, stats->replayLength);
+  fprintf(out, "%s\"idleTime\": %.3f,\n", indent,
+          (stats->totalTime - stats->searchTime - stats->copyTime) * 1000.0);
+  fprintf(out, "%s\"searchTime\": %.3f,\n", indent,
+          stats->searchTime * 1000.0);
+  fprintf(out, "%s\"copyTime\": %.3f,\n", indent, stats->copyTime * 1000.0);
+  writeSolverStats(out, &(stats->solverStats), indent);
+}
+
+// Print each processor's performance counters, and their totals, with their
+// counts per node the processors visited
+void printThreadPerf() {
+  unsigned i;
+  perfcounters_t total;
+  long long totalNodeCount = 0;
+
+  memset(&total, 0, sizeof(perfcounters_t));
+  for (i = 0; i < P; i++) {
+    printf("Perf Counters (processor %u, %lld nodes):\n", i,
+           threadPerf[i].nodeCount);
+    printPerfCounters(stdout, &(threadPerf[i].counters),
+                      threadPerf[i].nodeCount);
+    addPerfCounters(&total, &(threadPerf[i].counters));
+    totalNodeCount += threadPerf[i].nodeCount;
+  }
+
+  printf("Perf Counters (total, %lld nodes):\n", totalNodeCount);
+  printPerfCounters(stdout, &total, totalNodeCount);
+}
+
+// Record an event in a processor's trace, from start until now, overwriting
+// the oldest event if the trace is full
+void traceEvent(trace_buffer_t* trace, tracetype_t type, double start,
+                int length, int count) {
+  trace_event_t* event = &(trace->events[trace->numEvents %
+                                         TRACE_BUFFER_EVENTS]);
+
+  event->type = type;
+  event->length = length;
+  event->count = count;
+  event->start = start;
+  event->end = omp_get_wtime();
+  trace->numEvents++;
+}
+
+// Write the processors' traces to a file in the Chrome trace event format,
+// which chrome://tracing and Perfetto show as a timeline of each processor.
+// Times are in microseconds since the processors started.
+void writeTrace(char* file) {
+  unsigned i;
+  long long j, first, numDropped = 0;
+  trace_event_t* event;
+  FILE* out;
+
+  if (!(out = fopen(file, "w")))
+    unixError("Failed to open trace file");
+
+  fprintf(out, "{\"traceEvents\": [\n");
+  fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, "
+          "\"args\": {\"name\": \"parallel P=%u\"}}", P);
+  for (i = 0; i < P; i++) {
+    fprintf(out, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", "
+            "\"pid\": 0, \"tid\": %u, \"args\": {\"name\": "
+            "\"processor %u\"}}", i, i);
+
+    // Only the newest events are left once a trace wraps around
+    first = (traceBuffers[i].numEvents > TRACE_BUFFER_EVENTS) ?
+            traceBuffers[i].numEvents - TRACE_BUFFER_EVENTS : 0;
+    numDropped += first;
+    for (j = first; j < traceBuffers[i].numEvents; j++) {
+      event = &(traceBuffers[i].events[j % TRACE_BUFFER_EVENTS]);
+      fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"scheduler\", "
+              "\"pid\": 0, \"tid\": %u, \"ts\": %.3f, ",
+              traceEventNames[event->type], i,
+              (event->start - traceStartTime) * 1000000.0);
+
+      // Steals are instants, and other events last from start to end
+      if (event->type == STEAL_EVENT)
+        fprintf(out, "\"ph\": \"i\", \"s\": \"t\", ");
+      else
+        fprintf(out, "\"ph\": \"X\", \"dur\": %.3f, ",
+                (event->end - event->start) * 1000000.0);
+
+      fprintf(out, "\"args\": {\"length\": %d", event->length);
+      if (traceCountNames[event->type])
+        fprintf(out, ", \"%s\": %d", traceCountNames[event->type],
+                event->count);
+      fprintf(out, "}}");
+    }
+  }
+  fprintf(out, "\n],\n\"displayTimeUnit\": \"ms\",\n"
+          "\"otherData\": {\"droppedEvents\": %lld}}\n", numDropped);
+
+  if (fclose(out))
+    unixError("Failed to write trace file");
+}
 
 // Print usage information and exit
 void usage(char* program) {
-  printf("Usage: %s P filename\n", program);
+  printf("Usage: %s [--count | --unique | --all] [--stats stats_file] "
+         "[--trace trace_file] [--perf-counters] [search options] "
+         "[--portfolio K | --deterministic] P filename\n", program);
+  printf(SEARCH_OPTIONS_USAGE);
   exit(0);
 }
 
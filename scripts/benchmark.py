@@ -0,0 +1,255 @@
+#!/usr/bin/python
+
+# Benchmark the solvers over a set of puzzles and numbers of processors, and
+# compare the results against a baseline from an earlier run.
+
+from __future__ import print_function
+
+import json, math, os, re, subprocess, sys, time
+from optparse import OptionParser
+
+root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# Quick puzzles, from smallest to largest. 9.txt is by far the slowest, at
+# about a tenth of a second serially and several times that with a few
+# processors, so it takes most of the suite's time.
+DEFAULT_PUZZLES = ["3.txt", "4.txt", "5.txt", "6.txt", "7.txt", "8.txt",
+                   "9.txt", "kenken.txt"]
+DEFAULT_PROCESSORS = "1,2,4,8"
+
+# Command of each engine, run with the puzzle appended. Engines without {P}
+# only use one processor.
+ENGINES = {
+  "serial": "./serial",
+  "parallel": "./parallel {P}",
+  "deterministic": "./parallel --deterministic {P}",
+  "distributed": "./distributed --local {P} /tmp/kenken-benchmark.sock",
+}
+
+nodeRegex = re.compile('Nodes Visited: ([\d]+)')
+compRegex = re.compile('Computation Time = ([\d\.]+) millisecs')
+totalRegex = re.compile('      Total Time = ([\d\.]+) millisecs')
+
+def error(msg):
+  print(msg, file=sys.stderr)
+  sys.exit(2)
+
+def median(values):
+  values = sorted(values)
+  middle = len(values) // 2
+  if len(values) % 2:
+    return values[middle]
+  return (values[middle - 1] + values[middle]) / 2.0
+
+# Nearest-rank percentile
+def percentile(values, p):
+  values = sorted(values)
+  return values[max(0, int(math.ceil(p / 100.0 * len(values))) - 1)]
+
+# Run a command once, returning its nodes visited, computation time and total
+# time. Times the command itself if it does not print a total time.
+def runTrial(command):
+  start = time.time()
+  process = subprocess.Popen(command, shell=True, cwd=root,
+                             stdout=subprocess.PIPE,
+                             stderr=subprocess.STDOUT,
+                             universal_newlines=True)
+  output = process.communicate()[0]
+  wallTime = (time.time() - start) * 1000.0
+
+  nodes = nodeRegex.search(output)
+  comp = compRegex.search(output)
+  total = totalRegex.search(output)
+  if not nodes:
+    error("No nodes visited in output of: " + command + "\n" + output)
+
+  total = float(total.group(1)) if total else wallTime
+  comp = float(comp.group(1)) if comp else total
+  return (int(nodes.group(1)), comp, total)
+
+# Run an engine on a puzzle with the warmup runs and trials, and summarize
+# the trials
+def benchmark(engine, puzzle, processors, options):
+  command = ENGINES[engine].replace("{P}", str(processors)) + " " + puzzle
+  for i in range(options.warmup):
+    runTrial(command)
+
+  trials = [runTrial(command) for i in range(options.trials)]
+  nodes = [trial[0] for trial in trials]
+  compTimes = [trial[1] for trial in trials]
+  totalTimes = [trial[2] for trial in trials]
+  result = {
+    "engine": engine,
+    "puzzle": os.path.basename(puzzle),
+    "processors": processors,
+    "command": command,
+    "nodes": int(median(nodes)),
+    "totalTime": median(totalTimes),
+    "totalTimeP95": percentile(totalTimes, 95),
+    "compTime": median(compTimes),
+    "compTimeP95": percentile(compTimes, 95),
+    "trials": [{"nodes": trial[0], "compTime": trial[1],
+                "totalTime": trial[2]} for trial in trials],
+  }
+  result["nodesPerSec"] = (result["nodes"] * 1000.0 / result["compTime"]
+                           if result["compTime"] > 0 else 0.0)
+  print("%s %s P=%d: %.3f ms (p95 %.3f ms), %d nodes" %
+        (engine, result["puzzle"], processors, result["totalTime"],
+         result["totalTimeP95"], result["nodes"]), file=sys.stderr)
+  return result
+
+# Speedup of each result over the serial engine on the same puzzle, or over
+# the same engine with one processor if serial was not run
+def addSpeedups(results):
+  for result in results:
+    bases = [other for other in results
+             if other["puzzle"] == result["puzzle"] and
+             other["engine"] == "serial"]
+    if not bases:
+      bases = [other for other in results
+               if other["puzzle"] == result["puzzle"] and
+               other["engine"] == result["engine"] and
+               other["processors"] == 1]
+
+    if bases and result["totalTime"] > 0:
+      result["speedup"] = bases[0]["totalTime"] / result["totalTime"]
+      result["efficiency"] = result["speedup"] / result["processors"]
+    else:
+      result["speedup"] = None
+      result["efficiency"] = None
+
+# Write the results as blocks of rows for each engine and puzzle, like
+# reports/data.csv, with the summary statistics in extra columns
+def writeCsv(results, filename):
+  f = open(filename, "w")
+  blocks = []
+  for result in results:
+    if (result["engine"], result["puzzle"]) not in blocks:
+      blocks.append((result["engine"], result["puzzle"]))
+
+  for (engine, puzzle) in blocks:
+    f.write(engine + " " + puzzle + "\n")
+    f.write("Processors,Nodes,Total Time,Computational Time,"
+            "Total Time P95,Computational Time P95,Nodes/sec,Speedup,"
+            "Efficiency\n")
+    for result in results:
+      if result["engine"] != engine or result["puzzle"] != puzzle:
+        continue
+
+      f.write("%d,%d,%.3f,%.3f,%.3f,%.3f,%.0f,%s,%s\n" %
+              (result["processors"], result["nodes"], result["totalTime"],
+               result["compTime"], result["totalTimeP95"],
+               result["compTimeP95"], result["nodesPerSec"],
+               formatRatio(result["speedup"]),
+               formatRatio(result["efficiency"])))
+    f.write("\n")
+  f.close()
+
+def formatRatio(ratio):
+  return "" if ratio is None else "%.3f" % ratio
+
+# Compare the median total times against a baseline's, printing a row for
+# each result. Returns the number of regressions beyond the threshold.
+def compare(results, baseline, threshold):
+  numRegressions = 0
+
+  print("Engine,Puzzle,Processors,Baseline Time,Time,Change,Status")
+  for result in results:
+    matches = [old for old in baseline
+               if old["engine"] == result["engine"] and
+               old["puzzle"] == result["puzzle"] and
+               old["processors"] == result["processors"]]
+    if not matches:
+      continue
+
+    old = matches[0]
+    change = ((result["totalTime"] - old["totalTime"]) / old["totalTime"] * 100
+              if old["totalTime"] > 0 else 0.0)
+    status = "ok"
+    if change > threshold:
+      status = "REGRESSION"
+      numRegressions += 1
+    elif change < -threshold:
+      status = "improved"
+    if result["nodes"] != old["nodes"]:
+      status += " (nodes %d -> %d)" % (old["nodes"], result["nodes"])
+
+    print("%s,%s,%d,%.3f,%.3f,%+.1f%%,%s" %
+          (result["engine"], result["puzzle"], result["processors"],
+           old["totalTime"], result["totalTime"], change, status))
+
+  return numRegressions
+
+
+parser = OptionParser(usage="%prog [options] [puzzle ...]\n\n"
+                      "Puzzles default to the quick puzzles in input/.")
+parser.add_option("--engines", default="serial,parallel",
+                  help="engines to run, out of " +
+                  ", ".join(sorted(ENGINES.keys())) + " [%default]")
+parser.add_option("--engine", action="append", default=[],
+                  metavar="NAME=COMMAND",
+                  help="add an engine, with {P} replaced by the number of "
+                  "processors")
+parser.add_option("--processors", default=DEFAULT_PROCESSORS,
+                  help="numbers of processors [%default]")
+parser.add_option("--trials", type="int", default=5,
+                  help="trials per run [%default]")
+parser.add_option("--warmup", type="int", default=1,
+                  help="untimed runs before the trials [%default]")
+parser.add_option("--csv", help="write the results to a CSV file")
+parser.add_option("--json", help="write the results to a JSON file, which "
+                  "can be used as a baseline")
+parser.add_option("--baseline", help="compare against a JSON file of results")
+parser.add_option("--threshold", type="float", default=10.0,
+                  help="percent slower than the baseline that is a "
+                  "regression [%default]")
+(options, puzzles) = parser.parse_args()
+
+for engine in options.engine:
+  if "=" not in engine:
+    error("Engines are given as NAME=COMMAND")
+  (name, command) = engine.split("=", 1)
+  ENGINES[name] = command
+
+engines = [engine for engine in options.engines.split(",") if engine]
+engines += [engine.split("=", 1)[0] for engine in options.engine]
+for engine in engines:
+  if engine not in ENGINES:
+    error("Unknown engine: " + engine)
+
+processorCounts = [int(p) for p in options.processors.split(",")]
+if options.trials < 1 or options.warmup < 0 or min(processorCounts) < 1:
+  error("Trials and processors must be positive")
+
+# Read the baseline first, so it can be the file the results are written to
+if options.baseline:
+  baseline = json.load(open(options.baseline))["results"]
+
+if not puzzles:
+  puzzles = [os.path.join("input", puzzle) for puzzle in DEFAULT_PUZZLES]
+puzzles = [os.path.relpath(os.path.abspath(puzzle), root)
+           for puzzle in puzzles]
+
+results = []
+for puzzle in puzzles:
+  for engine in engines:
+    counts = processorCounts if "{P}" in ENGINES[engine] else [1]
+    for processors in counts:
+      results.append(benchmark(engine, puzzle, processors, options))
+addSpeedups(results)
+
+if options.csv:
+  writeCsv(results, options.csv)
+if options.json:
+  f = open(options.json, "w")
+  json.dump({"trials": options.trials, "warmup": options.warmup,
+             "results": results}, f, indent=2, sort_keys=True)
+  f.write("\n")
+  f.close()
+
+if options.baseline:
+  numRegressions = compare(results, baseline, options.threshold)
+  if numRegressions > 0:
+    print("%d regression(s) beyond %.1f%%" %
+          (numRegressions, options.threshold), file=sys.stderr)
+    sys.exit(1)
@@ -17,40 +17,72 @@
 #define TIME_DIFF(b, a) (((b).tv_sec - (a).tv_sec) * 1000.0 + \
                          ((b).tv_usec - (a).tv_usec) / 1000.0)
 
-int solve(int step);
+void writeStats(char* file, double compTime);
 void usage(char* program);
 
-// Problem grid
-cell_t* cells;
-// Constraints array
-constraint_t* constraints;
+// Solver state
+kenken_solver_t* solver;
+// Trail of the deductions made by propagation
+trail_t* trail;
+// Which solutions to search for
+solvemode_t mode;
+// Search options for the solver
+searchoptions_t options;
+// Number of solutions found
+long long numSolutions;
+// Writer for solutions
+writer_t* writer;
 // Number of nodes visited
 long long nodeCount;
+// Counters of the solver's work, kept if --stats is given
+solverstats_t stats;
+// Whether to count hardware events with performance counters, and the counters
+int usePerfCounters;
+perfcounters_t perfCounters;
 
 int main(int argc, char **argv) {
   struct timeval startTime, endTime;
   struct timeval compStartTime;
   double totalTime, compTime;
+  search_t search;
+  cellset_t conflict;
+  char* statsFile = removeOptionValue(&argc, argv, "--stats");
+  usePerfCounters = removeOption(&argc, argv, "--perf-counters");
 
-  if (argc != 2)
+  if (!getSearchOptions(&argc, argv, &options) ||
+      (int)(mode = getSolveMode(&argc, argv)) < 0 || argc != 2)
     usage(argv[0]);
 
   // Record start of total time
   gettimeofday(&startTime, NULL);
 
-  initialize(argv[1], &cells, &constraints);
+  solver = createSolver(argv[1]);
+  setSearchOptions(solver, &options);
+  trail = allocateTrail();
+  writer = allocateWriter(stdout);
+  if (statsFile)
+    solver->stats = &stats;
+  if (usePerfCounters)
+    openPerfCounters(&perfCounters);
+  numSolutions = 0;
   nodeCount = 0;
+  initSearch(&search, solver, trail, mode, writer, &nodeCount, &numSolutions);
 
   //Record start of Computation time
   gettimeofday(&compStartTime, NULL);
   
   // Run algorithm
-  if (!solve(0))
-    appError("No solution found");
+  if (usePerfCounters)
+    startPerfCounters(&perfCounters);
+  searchNode(&search, 0, &conflict);
+  if (usePerfCounters)
+    stopPerfCounters(&perfCounters);
 
   gettimeofday(&endTime, NULL);
-  printSolution(cells);
+  freeWriter(writer);
+  printSolutionCount(stdout, mode, numSolutions);
   printf("Nodes Visited: %lld\n", nodeCount);
+  printCacheCounts(stdout, &options, solver->cacheHits, solver->cacheMisses);
 
   compTime = TIME_DIFF(endTime, compStartTime);
   totalTime = TIME_DIFF(endTime, startTime);
@@ -58,36 +90,45 @@ int main(int argc, char **argv) {
   // Print out calculated times
   printf("Computation Time = %.3f millisecs\n", compTime);
   printf("      Total Time = %.3f millisecs\n", totalTime);
+  if (usePerfCounters) {
+    printf("Perf Counters:\n");
+    printPerfCounters(stdout, &perfCounters, nodeCount);
+    closePerfCounters(&perfCounters);
+  }
+  if (statsFile)
+    writeStats(statsFile, compTime);
 
+  freeTrail(trail);
+  freeSolver(solver);
+
+  // Fail after the nodes visited are printed, so they can still be merged
+  if (mode == FIRST_SOLUTION && numSolutions == 0)
+    appError("No solution found");
   return 0;
 }
 
-// Main recursive function used to solve the program
-int solve(int step) {
-  int cellIndex;
-  int value = UNASSIGNED_VALUE;
+// Write the counters of the search to a file as JSON
+void writeStats(char* file, double compTime) {
+  FILE* out;
 
-  // Success if all cells filled in
-  if (step == totalNumCells)
-    return 1;
+  if (!(out = fopen(file, "w")))
+    unixError("Failed to open stats file");
 
-  nodeCount++;
-  // Find the next cell to fill and test all possible values
-  if ((cellIndex = getNextCellToFill(cells, constraints)) == IMPOSSIBLE_STATE)
-    return 0;
+  fprintf(out, "{\n  \"solutions\": %lld,\n  \"nodes\": %lld,\n"
+          "  \"computationTime\": %.3f,\n", numSolutions, nodeCount,
+          compTime);
+  writeSolverStats(out, &stats, "  ");
+  fprintf(out, "}\n");
 
-  while (UNASSIGNED_VALUE != (value = applyNextValue(cells, constraints,
-                                                     cellIndex, value))) {
-    if (solve(step + 1))
-      return 1;
-  }
-
-  return 0;
+  if (fclose(out))
+    unixError("Failed to write stats file");
 }
 
 // Print usage information and exit
 void usage(char* program) {
-  printf("Usage: %s filename\n", program);
+  printf("Usage: %s [--count | --unique | --all] [--stats stats_file] "
+         "[--perf-counters] [search options] filename\n", program);
+  printf(SEARCH_OPTIONS_USAGE);
   exit(0);
 }
 
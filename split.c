@@ -0,0 +1,192 @@
+// ============================================================================
+// Jonathan Park (jjp1)
+// Ben Parr (bparr)
+//
+// File: split.c
+// Description: Splits a KenKen puzzle into subproblem puzzle files that can be
+//              solved independently, and merges the solvers' outputs.
+//
+// CS418 Project
+// ============================================================================
+
+#include "kenken.h"
+#include <sys/time.h>
+#include <ctype.h>
+
+// Most characters in a subproblem file's name
+#define MAX_FILE_NAME_LEN 4096
+
+// Calculate number of milliseconds between two timevals
+#define TIME_DIFF(b, a) (((b).tv_sec - (a).tv_sec) * 1000.0 + \
+                         ((b).tv_usec - (a).tv_usec) / 1000.0)
+
+// Algorithm functions
+void readPuzzle(char* file);
+void writeSubproblems(char* prefix);
+void mergeOutputs(int numFiles, char** files);
+void usage(char* program);
+
+
+// Which solutions to search for, when merging
+solvemode_t mode;
+// Search options for the solver
+searchoptions_t options;
+// Text of the puzzle, without its answer
+puzzletext_t* puzzle;
+// Solver state at the root, and the solver each subproblem is split with
+kenken_solver_t* solver;
+kenken_solver_t* mySolver;
+trail_t* myTrail;
+// Subproblems in the serial search order
+job_t* jobs;
+long numJobs;
+// Number of nodes visited
+long long nodeCount;
+
+int main(int argc, char **argv) {
+  long numSubproblems;
+  struct timeval startTime, endTime;
+
+  if (removeOption(&argc, argv, "--merge")) {
+    if ((int)(mode = getSolveMode(&argc, argv)) < 0 || argc < 2)
+      usage(argv[0]);
+
+    mergeOutputs(argc - 1, &(argv[1]));
+    return 0;
+  }
+
+  if (!getSearchOptions(&argc, argv, &options) || argc != 4)
+    usage(argv[0]);
+
+  numSubproblems = atol(argv[1]);
+  if (numSubproblems < 1)
+    usage(argv[0]);
+
+  // Record start of total time
+  gettimeofday(&startTime, NULL);
+
+  readPuzzle(argv[2]);
+  solver = createSolver(argv[2]);
+  setSearchOptions(solver, &options);
+  mySolver = cloneSolver(solver);
+  myTrail = allocateTrail();
+  nodeCount = 0;
+
+  jobs = splitJobs(solver, mySolver, myTrail, numSubproblems, &numJobs,
+                   &nodeCount);
+  writeSubproblems(argv[3]);
+
+  gettimeofday(&endTime, NULL);
+
+  printf("Subproblems: %ld\n", numJobs);
+  printf("Nodes Visited: %lld\n", nodeCount);
+  printf("      Total Time = %.3f millisecs\n",
+         TIME_DIFF(endTime, startTime));
+
+  free(jobs);
+  freePuzzleText(puzzle);
+  freeTrail(myTrail);
+  freeSolver(mySolver);
+  freeSolver(solver);
+  return 0;
+}
+
+// Read the text of the puzzle, including any given values but not its answer,
+// to copy into each subproblem
+void readPuzzle(char* file) {
+  FILE* in;
+
+  if (!(in = fopen(file, "r")))
+    unixError("Failed to open input file");
+
+  puzzle = allocatePuzzleText();
+  if (!readPuzzleText(in, puzzle))
+    appError("Incomplete puzzle in input file");
+
+  fclose(in);
+}
+
+// Write each job as a subproblem file named prefix followed by its position in
+// the serial search order, padded so the names sort in that order. Each file
+// is the puzzle followed by the job's assignments as given values.
+void writeSubproblems(char* prefix) {
+  long i;
+  int j, width;
+  char file[MAX_FILE_NAME_LEN];
+  FILE* out;
+
+  width = snprintf(NULL, 0, "%ld", numJobs);
+  for (i = 0; i < numJobs; i++) {
+    if (snprintf(file, MAX_FILE_NAME_LEN, "%s%0*ld.txt", prefix, width,
+                 i + 1) >= MAX_FILE_NAME_LEN)
+      appError("Subproblem file name too long");
+
+    if (!(out = fopen(file, "w")))
+      unixError("Failed to open subproblem file");
+
+    fwrite(puzzle->text, 1, puzzle->size, out);
+    for (j = 0; j < jobs[i].length; j++)
+      fprintf(out, "= %d %d,%d\n", jobs[i].assignments[j].value,
+              jobs[i].assignments[j].cellIndex / solver->N,
+              jobs[i].assignments[j].cellIndex % solver->N);
+
+    if (fclose(out))
+      unixError("Failed to write subproblem file");
+  }
+}
+
+// Merge the outputs of solving each subproblem, given in the serial search
+// order, as if the whole puzzle was solved: print the first solution or all
+// of them, followed by the number of solutions and the total nodes visited
+void mergeOutputs(int numFiles, char** files) {
+  int i, hasSolution;
+  char lineBuf[MAX_LINE_LEN];
+  long long numSolutions = 0, fileSolutions, fileNodeCount, totalNodeCount = 0;
+  FILE* in;
+
+  for (i = 0; i < numFiles; i++) {
+    if (!(in = fopen(files[i], "r")))
+      unixError("Failed to open output file");
+
+    hasSolution = 0;
+    fileSolutions = -1;
+    while (fgets(lineBuf, MAX_LINE_LEN, in)) {
+      if (sscanf(lineBuf, "Solutions: %lld", &fileSolutions) == 1 ||
+          !(isdigit(lineBuf[0]) || lineBuf[0] == '\n')) {
+        if (sscanf(lineBuf, "Nodes Visited: %lld", &fileNodeCount) == 1)
+          totalNodeCount += fileNodeCount;
+        continue;
+      }
+
+      // Solutions are lines of values, separated by blank lines when writing
+      // all of them. Only the first solution is printed otherwise.
+      hasSolution |= isdigit(lineBuf[0]);
+      if (mode == ALL_SOLUTIONS || numSolutions == 0)
+        fputs(lineBuf, stdout);
+    }
+
+    if (ferror(in))
+      unixError("Failed to read output file");
+    fclose(in);
+
+    // Solvers only print the number of solutions when searching for more
+    // than the first
+    numSolutions += (fileSolutions >= 0) ? fileSolutions : hasSolution;
+  }
+
+  printSolutionCount(stdout, mode, numSolutions);
+  printf("Nodes Visited: %lld\n", totalNodeCount);
+
+  if (mode == FIRST_SOLUTION && numSolutions == 0)
+    appError("No solution found");
+}
+
+// Print usage information and exit
+void usage(char* program) {
+  printf("Usage: %s [search options] number_of_subproblems filename "
+         "output_prefix\n", program);
+  printf("       %s --merge [--count | --unique | --all] output_file...\n",
+         program);
+  printf(SEARCH_OPTIONS_USAGE);
+  exit(0);
+}